@@ -23,8 +23,8 @@
 @property (weak) IBOutlet NSLevelIndicator *level6;
 
 @property (strong) Thread *serialThread;
+@property (strong) NSTimer *displayTimer;
 
 - (void)populatePortList;
-- (void)setChannels:(id)data;
 
 @end
@@ -12,30 +12,45 @@
 #import "Serial.h"
 #import "Thread.h"
 
-@implementation MainWindow
+#define DISPLAYINTERVAL (1.0 / 60.0)
+
+@implementation MainWindow {
+    unsigned int displayedSequence;
+}
 
 @synthesize portList, connectButton, createButton;
 @synthesize level1, level2, level3, level4, level5, level6;
-@synthesize serialThread;
+@synthesize serialThread, displayTimer;
 
 - (id)init {
     self = [super init];
     if (self != nil) {
         serialThread = nil;
+        displayTimer = nil;
         [self setDelegate:self];
     }
     return self;
 }
 
+- (void)stopThread {
+    [displayTimer invalidate];
+    displayTimer = nil;
+    
+    // The thread sends to the HID device, so wait for it to finish before closing that
+    [serialThread setRunning:NO];
+    while ([serialThread isFinished] == NO) {
+        usleep(1000);
+    }
+    serialThread = nil;
+    [fooHID close];
+    
+    uint16_t zero[CT6B_CHANNELS] = { 0 };
+    [self setChannels:zero];
+}
+
 - (BOOL)windowShouldClose:(id)sender {
     if (serialThread != nil) {
-        // Stop thread and wait for it to finish
-        [serialThread setRunning:NO];
-        while ([serialThread isFinished] == NO) {
-            usleep(1000);
-        }
-        serialThread = nil;
-        [fooHID close];
+        [self stopThread];
     }
     
     return YES;
@@ -50,17 +65,20 @@
         if ([serialThread openPort] != 0) {
             serialThread = nil;
         } else {
-            if ([fooHID init] == 0) {
+            struct sink_layout_t layout;
+            [serialThread getLayout:&layout];
+            if ([fooHID init:&layout] == 0) {
                 [serialThread start];
                 [connectButton setTitle:@"Disconnect"];
+                
+                displayedSequence = 0;
+                displayTimer = [NSTimer scheduledTimerWithTimeInterval:DISPLAYINTERVAL target:self selector:@selector(displayTimerFired:) userInfo:nil repeats:YES];
             } else {
                 serialThread = nil;
             }
         }
     } else {
-        [serialThread setRunning:NO];
-        serialThread = nil;
-        [fooHID close];
+        [self stopThread];
         [connectButton setTitle:@"Connect"];
     }
 }
@@ -85,21 +103,22 @@
     }
 }
 
-- (void)setChannels:(id)data {
-    if ([data count] < 6) {
-        NSLog(@"Not enough channel data (%lu)?!\n", (unsigned long)[data count]);
-    } else {
-        [level1 setDoubleValue:[[data objectAtIndex:0] doubleValue]];
-        [level2 setDoubleValue:[[data objectAtIndex:1] doubleValue]];
-        [level3 setDoubleValue:[[data objectAtIndex:2] doubleValue]];
-        [level4 setDoubleValue:[[data objectAtIndex:3] doubleValue]];
-        [level5 setDoubleValue:[[data objectAtIndex:4] doubleValue]];
-        [level6 setDoubleValue:[[data objectAtIndex:5] doubleValue]];
-        
-        if (serialThread != nil) {
-            [fooHID send:data];
-        }
+- (void)displayTimerFired:(NSTimer *)timer {
+    struct mailbox_entry_t entry;
+    unsigned int sequence = [serialThread latestChannels:&entry];
+    if (sequence != displayedSequence) {
+        displayedSequence = sequence;
+        [self setChannels:entry.frame.channels];
     }
 }
 
+- (void)setChannels:(const uint16_t *)data {
+    [level1 setDoubleValue:data[0]];
+    [level2 setDoubleValue:data[1]];
+    [level3 setDoubleValue:data[2]];
+    [level4 setDoubleValue:data[3]];
+    [level5 setDoubleValue:data[4]];
+    [level6 setDoubleValue:data[5]];
+}
+
 @end
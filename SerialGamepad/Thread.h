@@ -8,6 +8,9 @@
 
 #import <Foundation/Foundation.h>
 
+#include "mailbox.h"
+#include "sink.h"
+
 @class MainWindow;
 
 @interface Thread : NSThread
@@ -19,5 +22,7 @@
 
 - (id)initWithWindow:(MainWindow *)window;
 - (NSInteger)openPort;
+- (unsigned int)latestChannels:(struct mailbox_entry_t *)entry;
+- (void)getLayout:(struct sink_layout_t *)layout;
 
 @end
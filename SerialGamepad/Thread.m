@@ -14,23 +14,20 @@
 #import "fooHID.h"
 #import "MainWindow.h"
 
-#define CHANNELS 6
-#define TESTCHANNEL 2
-#define PACKETSIZE 18
-#define HEADERBYTES 2
-#define CHECKSUMBYTES 2
-#define PAYLOADBYTES (PACKETSIZE - HEADERBYTES - CHECKSUMBYTES)
-#define HEADERBYTE_A 85
-#define HEADERBYTE_B 252
+#include "decoder.h"
+#include "latency.h"
+#include "transfer.h"
 
-enum ThreadState {
-    READ_FIRST_BYTE,
-    READ_SECOND_BYTE,
-    READ_PAYLOAD,
-    READ_CHECKSUM
-};
+#define BUFFERSIZE 256
+#define FRAMES 16
+#define CHANNELMAXIMUM 1022
 
-@implementation Thread
+@implementation Thread {
+    // Written only by this thread, read by the GUI whenever it redraws
+    struct mailbox_t mailbox;
+    
+    struct transfer_t transfer;
+}
 
 @synthesize running, fd, portName, mainWindow;
 
@@ -38,10 +35,36 @@ enum ThreadState {
     self = [super init];
     if (self != nil) {
         mainWindow = window;
+        mailboxInit(&mailbox);
+        
+        // The layout doesn't depend on the protocol, detection can't change it
+        [self loadProfile:PROTOCOL_IBUS];
     }
     return self;
 }
 
+- (unsigned int)latestChannels:(struct mailbox_entry_t *)entry {
+    return mailboxRead(&mailbox, entry);
+}
+
+- (void)getLayout:(struct sink_layout_t *)layout {
+    transferLayout(&transfer, layout);
+}
+
+// Calibration of the protocol, changed by the profile set with
+// defaults write de.xythobuz.SerialGamepad Profile <path>
+- (void)loadProfile:(enum decoder_protocol_t)protocol {
+    transferInit(&transfer, protocol);
+    
+    NSString *profile = [[NSUserDefaults standardUserDefaults] stringForKey:@"Profile"];
+    if ((profile != nil) && (transferLoad(&transfer, [profile fileSystemRepresentation]) != 0)) {
+        NSLog(@"Ignoring invalid profile \"%@\"!\n", profile);
+        transferInit(&transfer, protocol);
+    }
+    
+    transferBuild(&transfer);
+}
+
 - (NSInteger)openPort {
     if (portName == nil) {
         return 1;
@@ -83,86 +106,68 @@ enum ThreadState {
 }
 
 - (void)main {
-    enum ThreadState state = READ_FIRST_BYTE;
-    unsigned char c = 0;
-    unsigned char buffer[PAYLOADBYTES];
-    unsigned char checksum[CHECKSUMBYTES];
-    uint16_t channels[CHANNELS + 1];
-    int received = 0;
+    struct detector_t detector;
+    struct decoder_t *decoder = NULL;
+    struct decoder_frame_t frames[FRAMES];
+    unsigned char buffer[BUFFERSIZE];
+    unsigned long checksumErrors = 0;
+    
+    // The line settings are chosen in the GUI, any protocol using them is detected
+    detectorInit(&detector);
     
     NSLog(@"Connection running...\n");
     
     running = YES;
     while (running) {
-        if (state == READ_FIRST_BYTE) {
-            if (read(fd, &c, 1) == 1) {
-                if (c == HEADERBYTE_A) {
-                    state = READ_SECOND_BYTE;
-                }
-            }
-        } else if (state == READ_SECOND_BYTE) {
-            if (read(fd, &c, 1) == 1) {
-                if (c == HEADERBYTE_B) {
-                    state = READ_PAYLOAD;
-                    received = 0;
-                } else {
-                    state = READ_FIRST_BYTE;
-                }
-            }
-        } else if (state == READ_PAYLOAD) {
-            ssize_t ret = read(fd, buffer + received, PAYLOADBYTES - received);
-            if (ret >= 0) received += ret;
-            if (received >= PAYLOADBYTES) {
-                state = READ_CHECKSUM;
-                received = 0;
-            }
-        } else if (state == READ_CHECKSUM) {
-            ssize_t ret = read(fd, checksum + received, CHECKSUMBYTES - received);
-            if (ret >= 0) received += ret;
-            if (received >= CHECKSUMBYTES) {
-                state = READ_FIRST_BYTE;
-                
-                uint16_t sum = 0;
-                for (int i = 0; i < PAYLOADBYTES; i++) {
-                    sum += buffer[i];
-                }
-                
-                if (sum != ((checksum[0] << 8) | checksum[1])) {
-                    NSLog(@"Wrong checksum: %d != %d\n", sum, ((checksum[0] << 8) | checksum[1]));
-                } else {
-                    for (int i = 0; i < (CHANNELS + 1); i++) {
-                        channels[i] = buffer[2 * i] << 8;
-                        channels[i] |= buffer[(2 * i) + 1];
-                    
-                        if (i < CHANNELS) {
-                            channels[i] -= 1000;
-                        }
-                    }
-                    
-                    if (channels[CHANNELS] != channels[TESTCHANNEL]) {
-                        // This channel contains the throttle value even if it has been disabled using the switches
-                        // on the transmitter. Therefore, there's not really a warning required here.
-                        //NSLog(@"Wrong test channel value: %d != %d\n", channels[CHANNELS], channels[TESTCHANNEL]);
-                    }
-                    
-                    NSMutableArray *arr = [[NSMutableArray alloc] initWithCapacity:CHANNELS];
-                    for (int i = 0; i < CHANNELS; i++) {
-                        [arr addObject:[[NSNumber alloc] initWithInteger:(NSInteger)channels[i]]];
-                    }
-                    
-                    [mainWindow performSelectorOnMainThread:@selector(setChannels:) withObject:arr waitUntilDone:NO];
-                }
+        // Returns after at most .1 seconds, see VTIME
+        ssize_t ret = read(fd, buffer, BUFFERSIZE);
+        if (ret <= 0) {
+            continue;
+        }
+        
+        int count;
+        if (decoder == NULL) {
+            count = detectorFeed(&detector, buffer, (int)ret, frames, FRAMES);
+            decoder = detectorDecoder(&detector);
+            if (decoder == NULL) {
+                continue;
             }
+            NSLog(@"Detected %s protocol\n", decoderName(decoder->protocol));
+            [self loadProfile:decoder->protocol];
         } else {
-            NSLog(@"Invalid state?!\n");
-            state = READ_FIRST_BYTE;
+            count = decoderFeed(decoder, buffer, (int)ret, frames, FRAMES);
+        }
+        
+        if (decoder->checksumErrors != checksumErrors) {
+            NSLog(@"Wrong checksum (%lu total, %lu frames recovered)\n", decoder->checksumErrors, decoder->resyncs);
+            checksumErrors = decoder->checksumErrors;
+        }
+        
+        if (count == 0) {
+            continue;
         }
+        
+        // Only the newest frame is relevant. The test channel contains the throttle value even if it
+        // has been disabled using the switches on the transmitter, so DECODER_FLAG_TESTCHANNEL is ignored.
+        struct mailbox_entry_t entry;
+        entry.frame = frames[count - 1];
+        entry.time = latencyNow();
+        
+        struct sink_report_t report;
+        transferApply(&transfer, &entry.frame, &report);
+        
+        // The bars show the channels, 0 - 1022. CT6B values start at 1000, the others are centered on 1500.
+        int offset = (decoder->protocol == PROTOCOL_CT6B) ? 1000 : (1500 - 511);
+        for (int i = 0; i < entry.frame.count; i++) {
+            int value = entry.frame.channels[i] - offset;
+            entry.frame.channels[i] = (value < 0) ? 0 : ((value > CHANNELMAXIMUM) ? CHANNELMAXIMUM : value);
+        }
+        
+        // No allocation and no detour through the main run loop, the GUI picks the values up itself
+        mailboxWrite(&mailbox, &entry);
+        [fooHID send:&report];
     }
     
-    // Ensure the GUI is always reset after clicking Disconnect
-    NSArray *zero = [NSArray arrayWithObjects:[NSNumber numberWithInt:0], [NSNumber numberWithInt:0], [NSNumber numberWithInt:0], [NSNumber numberWithInt:0], [NSNumber numberWithInt:0], [NSNumber numberWithInt:0], nil];
-    [mainWindow performSelectorOnMainThread:@selector(setChannels:) withObject:zero waitUntilDone:NO];
-    
     close(fd);
     NSLog(@"Connection closed...\n");
     fd = -1;
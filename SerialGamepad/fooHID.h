@@ -8,10 +8,12 @@
 
 #import <Foundation/Foundation.h>
 
+#include "sink.h"
+
 @interface fooHID : NSObject
 
-+ (NSInteger)init;
++ (NSInteger)init:(const struct sink_layout_t *)layout;
 + (void)close;
-+ (void)send:(NSArray *)data;
++ (void)send:(const struct sink_report_t *)report;
 
 @end
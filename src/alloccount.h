@@ -0,0 +1,26 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _ALLOCCOUNT_H_
+#define _ALLOCCOUNT_H_
+
+/*
+ * Counts the heap allocations of a benchmark. Linking alloccount.o
+ * replaces malloc(), calloc() and realloc() of glibc with versions
+ * that count their calls, so it is never linked into the apps.
+ */
+
+/*!
+ * \brief number of heap allocations made by the process
+ * \returns count, or -1 if they can't be counted with this C library
+ */
+long allocCount(void);
+
+#endif
+
@@ -0,0 +1,198 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Decoder benchmark suite. Feeds deterministic synthetic streams of
+ * every protocol to the decoder in several delivery scenarios and
+ * reports the throughput. Results can also be written as CSV, to be
+ * compared between two versions of the decoder.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "decoder.h"
+
+#define STREAMFRAMES 2000 // frames in one synthetic stream
+#define BENCHTIME 200000000 // ns each case runs at least
+#define CHUNK 64 // bytes per call, about one USB serial transfer
+#define MISALIGNEDCHUNK 61 // bytes per call, so frames straddle calls
+#define MISALIGNEDPREFIX 7 // garbage bytes before the first frame
+#define CORRUPTION 100 // one in this many bytes is corrupted
+#define SEED 42
+#define FRAMES 64
+
+enum scenario_t {
+    SCENARIO_CLEAN = 0,
+    SCENARIO_CORRUPT,
+    SCENARIO_MISALIGNED,
+    SCENARIO_TRICKLE,
+
+    SCENARIO_COUNT
+};
+
+static const char *scenarioNames[SCENARIO_COUNT] = {
+    [SCENARIO_CLEAN] = "clean",
+    [SCENARIO_CORRUPT] = "corrupt",
+    [SCENARIO_MISALIGNED] = "misaligned",
+    [SCENARIO_TRICKLE] = "trickle",
+};
+
+struct result_t {
+    unsigned long frames; //!< valid frames decoded
+    unsigned long bytes; //!< bytes fed to the decoder
+    unsigned long checksumErrors;
+    uint64_t time; //!< ns
+};
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint32_t random32(uint32_t *seed) {
+    *seed = (*seed * 1103515245) + 12345;
+    return *seed >> 8;
+}
+
+/*
+ * Slowly moving sticks, like a real transmitter.
+ * Returns the number of bytes written to stream.
+ */
+static int generate(enum decoder_protocol_t protocol, enum scenario_t scenario,
+        unsigned char *stream, int *expected) {
+    uint32_t seed = SEED;
+    int length = 0;
+
+    if (scenario == SCENARIO_MISALIGNED) {
+        for (int i = 0; i < MISALIGNEDPREFIX; i++) {
+            stream[length++] = random32(&seed);
+        }
+    }
+
+    struct decoder_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    for (int f = 0; f < STREAMFRAMES; f++) {
+        for (int i = 0; i < DECODER_MAX_CHANNELS; i++) {
+            frame.channels[i] = 1000 + (((f * (i + 1)) + (random32(&seed) % 16)) % 1001);
+        }
+        length += decoderEncode(protocol, &frame, stream + length);
+    }
+    *expected = STREAMFRAMES;
+
+    if (scenario == SCENARIO_CORRUPT) {
+        for (int i = 0; i < (length / CORRUPTION); i++) {
+            stream[random32(&seed) % length] ^= (random32(&seed) % 255) + 1;
+        }
+        *expected = -1; // unknown, some frames are lost
+    }
+
+    return length;
+}
+
+static void run(enum decoder_protocol_t protocol, enum scenario_t scenario,
+        const unsigned char *stream, int length, struct result_t *result) {
+    struct decoder_t decoder;
+    struct decoder_frame_t frames[FRAMES];
+    decoderInit(&decoder, protocol);
+
+    int chunk = CHUNK;
+    if (scenario == SCENARIO_MISALIGNED) {
+        chunk = MISALIGNEDCHUNK;
+    } else if (scenario == SCENARIO_TRICKLE) {
+        chunk = 1;
+    }
+
+    memset(result, 0, sizeof(struct result_t));
+    uint64_t start = now();
+    do {
+        for (int pos = 0; pos < length; pos += chunk) {
+            int n = ((length - pos) < chunk) ? (length - pos) : chunk;
+            decoderFeed(&decoder, stream + pos, n, frames, FRAMES);
+        }
+        result->bytes += length;
+        result->time = now() - start;
+    } while (result->time < BENCHTIME);
+
+    result->frames = decoder.frames;
+    result->checksumErrors = decoder.checksumErrors;
+}
+
+int main(int argc, char* argv[]) {
+    const char *csvPath = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        if (opt == 'o') {
+            csvPath = optarg;
+        } else {
+            fprintf(stderr, "Usage:\n\t%s [-o results.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *csv = NULL;
+    if (csvPath != NULL) {
+        csv = fopen(csvPath, "w");
+        if (csv == NULL) {
+            perror("Couldn't create result file");
+            return 1;
+        }
+        fprintf(csv, "protocol,scenario,frames,bytes,ns_per_frame,frames_per_s,bytes_per_s,checksum_errors\n");
+    }
+
+    unsigned char *stream = malloc((STREAMFRAMES * DECODER_MAX_FRAME) + MISALIGNEDPREFIX);
+    if (stream == NULL) {
+        return 1;
+    }
+
+    int failed = 0;
+    printf("%-5s %-10s %10s %12s %10s %12s\n", "", "", "ns/frame", "frames/s", "MB/s", "crc errors");
+    for (int p = 0; p < PROTOCOL_COUNT; p++) {
+        for (int s = 0; s < SCENARIO_COUNT; s++) {
+            int expected;
+            int length = generate(p, s, stream, &expected);
+
+            struct result_t r;
+            run(p, s, stream, length, &r);
+
+            double nsPerFrame = (double)r.time / r.frames;
+            double framesPerSecond = r.frames * 1e9 / r.time;
+            double bytesPerSecond = r.bytes * 1e9 / r.time;
+
+            printf("%-5s %-10s %10.1f %12.0f %10.1f %12lu\n", decoderName(p), scenarioNames[s],
+                    nsPerFrame, framesPerSecond, bytesPerSecond / 1e6, r.checksumErrors);
+
+            if (csv != NULL) {
+                fprintf(csv, "%s,%s,%lu,%lu,%.2f,%.0f,%.0f,%lu\n", decoderName(p), scenarioNames[s],
+                        r.frames, r.bytes, nsPerFrame, framesPerSecond, bytesPerSecond,
+                        r.checksumErrors);
+            }
+
+            // Clean streams must decode completely, every single time
+            unsigned long passes = r.bytes / length;
+            if ((expected >= 0) && ((r.frames != (passes * expected)) || (r.checksumErrors != 0))) {
+                fprintf(stderr, "%s %s: decoded %lu of %lu frames\n", decoderName(p),
+                        scenarioNames[s], r.frames, passes * expected);
+                failed = 1;
+            }
+        }
+    }
+
+    free(stream);
+    if (csv != NULL) {
+        fclose(csv);
+    }
+
+    return failed;
+}
+
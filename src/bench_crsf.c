@@ -0,0 +1,132 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decoder.h"
+
+#define CHANNELFRAME 26 // sync, length, type, 22 bytes payload, crc
+#define LINKFRAME 14 // sync, length, type, 10 bytes payload, crc
+#define LINKRATIO 10 // channel frames per link statistics frame
+#define FRAMES 1000
+#define ITERATIONS 5000
+#define RATE 1000 // Hz, fastest ExpressLRS packet rate
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint8_t crcBitwise(const unsigned char *data, int length) {
+    uint8_t crc = 0;
+    while (length-- > 0) {
+        crc ^= *(data++);
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0xD5) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t table[256];
+
+static uint8_t crcTable(const unsigned char *data, int length) {
+    uint8_t crc = 0;
+    while (length-- > 0) {
+        crc = table[crc ^ *(data++)];
+    }
+    return crc;
+}
+
+static int frame(unsigned char *p, int type, int payloadLength, uint32_t *seed) {
+    p[0] = 0xC8;
+    p[1] = payloadLength + 2;
+    p[2] = type;
+    for (int i = 0; i < payloadLength; i++) {
+        *seed = (*seed * 1103515245) + 12345;
+        p[3 + i] = *seed >> 16;
+    }
+    p[3 + payloadLength] = decoderCrc8(p + 2, payloadLength + 1);
+    return payloadLength + 4;
+}
+
+static void runCrc(const char *name, uint8_t (*crc)(const unsigned char *, int),
+        const unsigned char *stream, const int *offsets, int count, unsigned int *sum) {
+    uint64_t start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int f = 0; f < count; f++) {
+            const unsigned char *p = stream + offsets[f];
+            *sum += crc(p + 2, p[1] - 1);
+        }
+    }
+    double ns = (double)(now() - start) / ((double)ITERATIONS * count);
+    printf("crc %-8s %8.2f ns/frame\n", name, ns);
+}
+
+int main(int argc, char* argv[]) {
+    static unsigned char stream[FRAMES * CHANNELFRAME];
+    static int offsets[FRAMES];
+    int length = 0, count = 0;
+    uint32_t seed = 42;
+
+    for (int i = 0; i < 256; i++) {
+        table[i] = crcBitwise((unsigned char *)&i, 1);
+    }
+
+    // Channel frames with some link statistics in between, like a receiver sends them
+    while (count < FRAMES) {
+        offsets[count++] = length;
+        if ((count % LINKRATIO) == 0) {
+            length += frame(stream + length, 0x14, 10, &seed);
+        } else {
+            length += frame(stream + length, 0x16, 22, &seed);
+        }
+    }
+
+    for (int f = 0; f < count; f++) {
+        const unsigned char *p = stream + offsets[f];
+        uint8_t a = crcBitwise(p + 2, p[1] - 1);
+        if ((a != crcTable(p + 2, p[1] - 1)) || (a != decoderCrc8(p + 2, p[1] - 1))) {
+            fprintf(stderr, "CRC mismatch in frame %d\n", f);
+            return 1;
+        }
+    }
+
+    unsigned int sum = 0;
+    runCrc("bitwise", crcBitwise, stream, offsets, count, &sum);
+    runCrc("table", crcTable, stream, offsets, count, &sum);
+    runCrc("slice8", decoderCrc8, stream, offsets, count, &sum);
+
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_CRSF);
+    struct decoder_frame_t out[64];
+    uint64_t start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        // Feed in chunks, as a 420kbaud link delivers about 3 frames per read
+        for (int p = 0; p < length; p += 64) {
+            int chunk = ((length - p) < 64) ? (length - p) : 64;
+            int n = decoderFeed(&decoder, stream + p, chunk, out, 64);
+            if (n > 0) {
+                sum += out[n - 1].channels[0];
+            }
+        }
+    }
+    double ns = (double)(now() - start) / ((double)ITERATIONS * count);
+    printf("decoder      %8.2f ns/frame (%lu channel, %lu link, %lu errors)\n", ns,
+            decoder.frames, decoder.linkFrames, decoder.checksumErrors);
+    printf("at %d Hz     %8.4f %% of one core\n", RATE, ns * RATE / 1e7);
+
+    return (sum == 0) ? 1 : 0;
+}
+
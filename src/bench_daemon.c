@@ -0,0 +1,300 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Multi-receiver benchmark. Feeds iBus frames into up to 64 pseudo
+ * terminals, each one on its own phase like independent receivers, and
+ * compares the CPU time of one foohid process per port with a single
+ * foohidd serving all of them. Fails if any of the processes fails, or
+ * if any port decoded a different number of frames than were sent.
+ * Finally one port of foohidd is closed halfway, the daemon has to keep
+ * serving the other one and still exit on SIGINT.
+ * Run from the top of the repository, after make bin/foohid bin/foohidd.
+ */
+
+#define _GNU_SOURCE // posix_openpt(), cfmakeraw()
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "decoder.h"
+#include "latency.h"
+
+#define MAXPORTS 64
+#define PERIOD 7000000 // ns between two frames of a port, like iBus
+#define STARTUP 500000000 // ns for the processes to open their ports
+#define DURATION 3000000000ULL // ns frames are sent for
+#define DRAIN 200000000 // ns for the processes to read the last frames
+#define EXITTIMEOUT 2000 // ms for a process to exit after SIGINT
+
+static const int portCounts[] = { 1, 8, 64 };
+#define CASES (sizeof(portCounts) / sizeof(portCounts[0]))
+
+static int masters[MAXPORTS];
+static int slaves[MAXPORTS];
+static char paths[MAXPORTS][64];
+static unsigned long sent[MAXPORTS]; // frames written to each port
+
+static int openTerminal(int i) {
+    masters[i] = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((masters[i] == -1) || (grantpt(masters[i]) != 0) || (unlockpt(masters[i]) != 0)) {
+        perror("Couldn't create pseudo terminal");
+        return -1;
+    }
+    snprintf(paths[i], sizeof(paths[i]), "%s", ptsname(masters[i]));
+
+    // Keep the slave open and raw, like the emulator does
+    slaves[i] = open(paths[i], O_RDWR | O_NOCTTY);
+    if (slaves[i] == -1) {
+        perror("Couldn't open pseudo terminal");
+        return -1;
+    }
+    struct termios options;
+    tcgetattr(slaves[i], &options);
+    cfmakeraw(&options);
+    tcsetattr(slaves[i], TCSANOW, &options);
+    fcntl(masters[i], F_SETFL, fcntl(masters[i], F_GETFL) | O_NONBLOCK);
+
+    // Otherwise the processes keep every terminal open, and closing one never hangs up
+    fcntl(masters[i], F_SETFD, FD_CLOEXEC);
+    fcntl(slaves[i], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+// Starts a process printing into output
+static pid_t spawn(char **args, FILE *output) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fileno(output), STDOUT_FILENO);
+        execv(args[0], args);
+        perror("Couldn't start");
+        _exit(1);
+    }
+    return pid;
+}
+
+static void sleepUntil(uint64_t time) {
+    uint64_t now = latencyNow();
+    if (time > now) {
+        struct timespec ts;
+        ts.tv_sec = (time - now) / 1000000000;
+        ts.tv_nsec = (time - now) % 1000000000;
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Sends frames to the first count ports, returns the number of frames written.
+// With lose, the first port is closed halfway, like an unplugged receiver.
+static unsigned long sendFrames(int count, int lose) {
+    struct decoder_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.count = IBUS_CHANNELS;
+
+    unsigned long total = 0;
+    memset(sent, 0, sizeof(sent));
+    uint64_t start = latencyNow();
+    for (uint64_t slot = 0; ; slot++) {
+        // The ports take turns, spread evenly over the frame period
+        uint64_t time = start + (slot * PERIOD / count);
+        if ((time - start) >= DURATION) {
+            break;
+        }
+        sleepUntil(time);
+        if (lose && (masters[0] != -1) && ((time - start) >= (DURATION / 2))) {
+            close(masters[0]);
+            masters[0] = -1;
+        }
+        if (masters[slot % count] == -1) {
+            continue;
+        }
+
+        for (int c = 0; c < IBUS_CHANNELS; c++) {
+            frame.channels[c] = 1000 + ((slot + (c * 97)) % 1000);
+        }
+        unsigned char data[DECODER_MAX_FRAME];
+        int length = decoderEncode(PROTOCOL_IBUS, &frame, data);
+        if (write(masters[slot % count], data, length) == length) {
+            sent[slot % count]++;
+            total++;
+        }
+    }
+    return total;
+}
+
+// Frames decoded from port, as printed with -L, or -1 if it is missing
+static long decodedFrames(FILE *output, int port) {
+    char line[512];
+    size_t length = strlen(paths[port]);
+    rewind(output);
+    while (fgets(line, sizeof(line), output) != NULL) {
+        unsigned long frames;
+        if ((strncmp(line, paths[port], length) == 0) && (line[length] == ':')
+                && (sscanf(line + length, ": %*[^,], %lu frames", &frames) == 1)) {
+            return frames; // foohidd, one line per port
+        }
+        if (sscanf(line, "Read %*[^:]: %lu frames", &frames) == 1) {
+            return frames; // foohid, only one port
+        }
+    }
+    return -1;
+}
+
+// Waits for a process to exit, killing it if it takes too long. Returns 0 on success.
+static int reap(pid_t pid, struct rusage *usage) {
+    int status;
+    for (int ms = 0; ms < EXITTIMEOUT; ms++) {
+        pid_t ret = wait4(pid, &status, WNOHANG, usage);
+        if (ret == pid) {
+            return (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : -1;
+        } else if (ret == -1) {
+            return -1;
+        }
+        sleepUntil(latencyNow() + 1000000);
+    }
+    fprintf(stderr, "Process %d hangs, killing it\n", (int)pid);
+    kill(pid, SIGKILL);
+    wait4(pid, &status, 0, usage);
+    return -1;
+}
+
+// Runs one case, returns the CPU time of all processes in ms, or -1 on failure.
+// With lose, the first port is lost halfway and its frames aren't checked.
+static double runCase(int count, int daemon, int lose, unsigned long *total) {
+    pid_t pids[MAXPORTS];
+    FILE *outputs[MAXPORTS];
+    int processes = 0;
+    if (daemon) {
+        char *args[4 + (2 * MAXPORTS) + 1];
+        int n = 0;
+        args[n++] = "bin/foohidd";
+        args[n++] = "-i";
+        args[n++] = "-onull";
+        args[n++] = "-L";
+        for (int i = 0; i < count; i++) {
+            args[n++] = "-p";
+            args[n++] = paths[i];
+        }
+        args[n] = NULL;
+        outputs[processes] = tmpfile();
+        if (outputs[processes] == NULL) {
+            perror("Couldn't create output file");
+            return -1.0;
+        }
+        pids[processes] = spawn(args, outputs[processes]);
+        processes++;
+    } else {
+        for (int i = 0; i < count; i++) {
+            char *args[] = { "bin/foohid", "-i", "-onull", "-L", "-p", paths[i], NULL };
+            outputs[processes] = tmpfile();
+            if (outputs[processes] == NULL) {
+                perror("Couldn't create output file");
+                return -1.0;
+            }
+            pids[processes] = spawn(args, outputs[processes]);
+            processes++;
+        }
+    }
+
+    sleepUntil(latencyNow() + STARTUP);
+    *total = sendFrames(count, lose);
+    sleepUntil(latencyNow() + DRAIN);
+
+    double cpu = 0.0;
+    int failed = 0;
+    for (int i = 0; i < processes; i++) {
+        kill(pids[i], SIGINT);
+    }
+    for (int i = 0; i < processes; i++) {
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        if (reap(pids[i], &usage) != 0) {
+            failed = 1;
+        }
+        cpu += (usage.ru_utime.tv_sec * 1e3) + (usage.ru_utime.tv_usec / 1e3)
+            + (usage.ru_stime.tv_sec * 1e3) + (usage.ru_stime.tv_usec / 1e3);
+    }
+
+    // Cheap is worthless if frames went missing
+    for (int i = lose ? 1 : 0; i < count; i++) {
+        long decoded = decodedFrames(outputs[daemon ? 0 : i], i);
+        if (decoded != (long)sent[i]) {
+            fprintf(stderr, "%s: %ld of %lu frames decoded\n", paths[i], decoded, sent[i]);
+            failed = 1;
+        }
+    }
+    for (int i = 0; i < processes; i++) {
+        fclose(outputs[i]);
+    }
+    return failed ? -1.0 : cpu;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 0; i < MAXPORTS; i++) {
+        if (openTerminal(i) != 0) {
+            return 1;
+        }
+    }
+
+    printf("iBus at %.0fHz per port, %.0fs per case, CPU time of all processes\n",
+            1e9 / PERIOD, DURATION / 1e9);
+    printf("%-6s %-20s %10s %10s %12s %12s\n", "ports", "", "frames", "CPU %", "us/frame", "us/port/s");
+
+    int failed = 0;
+    for (int i = 0; i < CASES; i++) {
+        for (int daemon = 0; daemon < 2; daemon++) {
+            unsigned long total;
+            double cpu = runCase(portCounts[i], daemon, 0, &total);
+            if (cpu < 0.0) {
+                fprintf(stderr, "%s failed with %d ports\n", daemon ? "foohidd" : "foohid", portCounts[i]);
+                failed = 1;
+                continue;
+            }
+
+            char name[32];
+            if (daemon) {
+                snprintf(name, sizeof(name), "1 foohidd");
+            } else {
+                snprintf(name, sizeof(name), "%d foohid", portCounts[i]);
+            }
+            printf("%-6d %-20s %10lu %10.2f %12.2f %12.1f\n", portCounts[i], name, total,
+                    cpu * 1e6 / DURATION * 100.0,
+                    (total > 0) ? (cpu * 1e3 / total) : 0.0,
+                    cpu * 1e3 / (DURATION / 1e9) / portCounts[i]);
+        }
+    }
+
+    // Losing one receiver must not take the others down
+    unsigned long total;
+    double cpu = runCase(2, 1, 1, &total);
+    if (cpu < 0.0) {
+        fprintf(stderr, "foohidd failed after losing a port\n");
+        failed = 1;
+    } else {
+        printf("%-6d %-20s %10lu %10.2f %12.2f %12.1f\n", 2, "1 foohidd, 1 lost", total,
+                cpu * 1e6 / DURATION * 100.0, (total > 0) ? (cpu * 1e3 / total) : 0.0,
+                cpu * 1e3 / (DURATION / 1e9) / 2);
+    }
+
+    for (int i = 0; i < MAXPORTS; i++) {
+        close(slaves[i]);
+        if (masters[i] != -1) {
+            close(masters[i]);
+        }
+    }
+    return failed;
+}
+
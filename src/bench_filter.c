@@ -0,0 +1,197 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Channel filter benchmark. Measures the time per frame of each filter
+ * with vector instructions and without, the delay a filter adds to a
+ * step of the sticks and how much noise it removes. Fails if both
+ * implementations disagree or a single frame spike gets through the median.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+#include "filter.h"
+
+#define STREAMFRAMES 4096 // frames filtered in one pass
+#define BENCHTIME 200000000 // ns each case runs at least
+#define PERIOD 7000000 // ns between two frames, like iBus
+#define NOISE 4 // largest noise added to the sticks
+#define SPIKEINTERVAL 200 // frames between two spikes
+#define STEPLOW 1000
+#define STEPHIGH 2000
+#define STEPFRAMES 200 // frames followed after a step
+#define SEED 42
+
+static const char *cases[] = { "median", "euro", "median,euro" };
+#define CASES (sizeof(cases) / sizeof(cases[0]))
+
+static uint32_t random32(uint32_t *seed) {
+    *seed = (*seed * 1103515245) + 12345;
+    return *seed >> 8;
+}
+
+// Keeps the compiler from dropping the work
+static volatile int32_t sink;
+
+static void frameSet(struct decoder_frame_t *frame, int value) {
+    for (int c = 0; c < DECODER_MAX_CHANNELS; c++) {
+        frame->channels[c] = value;
+    }
+    frame->count = IBUS_CHANNELS;
+    frame->flags = 0;
+}
+
+// Frames until the output of a step from STEPLOW to STEPHIGH reaches percent of it
+static int stepFrames(const char *filters, int percent) {
+    struct filter_t f;
+    filterParse(&f, filters);
+
+    struct decoder_frame_t frame;
+    uint64_t time = 0;
+    for (int i = 0; i < 10; i++) {
+        frameSet(&frame, STEPLOW);
+        filterApply(&f, &frame, time += PERIOD);
+    }
+    for (int i = 0; i < STEPFRAMES; i++) {
+        frameSet(&frame, STEPHIGH);
+        filterApply(&f, &frame, time += PERIOD);
+        if (frame.channels[0] >= (STEPLOW + ((STEPHIGH - STEPLOW) * percent / 100))) {
+            return i;
+        }
+    }
+    return STEPFRAMES;
+}
+
+// Standard deviation of a channel at rest with noise, after filtering
+static double restNoise(const char *filters) {
+    struct filter_t f;
+    if ((filters != NULL) && (filterParse(&f, filters) != 0)) {
+        return -1.0;
+    }
+
+    uint32_t seed = SEED;
+    double sum = 0.0, squares = 0.0;
+    uint64_t time = 0;
+    for (int i = 0; i < STREAMFRAMES; i++) {
+        struct decoder_frame_t frame;
+        frameSet(&frame, 1500 + (int)(random32(&seed) % ((2 * NOISE) + 1)) - NOISE);
+        if (filters != NULL) {
+            filterApply(&f, &frame, time += PERIOD);
+        }
+        sum += frame.channels[0];
+        squares += (double)frame.channels[0] * frame.channels[0];
+    }
+    double mean = sum / STREAMFRAMES;
+    return sqrt((squares / STREAMFRAMES) - (mean * mean));
+}
+
+int main(int argc, char* argv[]) {
+    // Random walk of all sticks with noise and an occasional spike
+    struct decoder_frame_t *frames = malloc(STREAMFRAMES * sizeof(struct decoder_frame_t));
+    if (frames == NULL) {
+        return 1;
+    }
+    uint32_t seed = SEED;
+    int values[DECODER_MAX_CHANNELS];
+    for (int c = 0; c < DECODER_MAX_CHANNELS; c++) {
+        values[c] = 1500;
+    }
+    for (int f = 0; f < STREAMFRAMES; f++) {
+        for (int c = 0; c < DECODER_MAX_CHANNELS; c++) {
+            values[c] += (int)(random32(&seed) % 41) - 20;
+            if (values[c] < 1000) {
+                values[c] = 1000;
+            } else if (values[c] > 2000) {
+                values[c] = 2000;
+            }
+            frames[f].channels[c] = values[c] + (int)(random32(&seed) % ((2 * NOISE) + 1)) - NOISE;
+        }
+        if ((f % SPIKEINTERVAL) == (SPIKEINTERVAL - 1)) {
+            frames[f].channels[random32(&seed) % IBUS_CHANNELS] = 2100;
+        }
+        frames[f].count = IBUS_CHANNELS;
+        frames[f].flags = 0;
+    }
+
+    // Both implementations must give exactly the same values
+    int failed = 0;
+    for (int i = 0; i < CASES; i++) {
+        struct filter_t a, b;
+        filterParse(&a, cases[i]);
+        filterParse(&b, cases[i]);
+        for (int f = 0; f < STREAMFRAMES; f++) {
+            struct decoder_frame_t x = frames[f], y = frames[f];
+            filterApply(&a, &x, (uint64_t)f * PERIOD);
+            filterApplyScalar(&b, &y, (uint64_t)f * PERIOD);
+            if (memcmp(x.channels, y.channels, sizeof(x.channels)) != 0) {
+                fprintf(stderr, "%s, frame %d: %s and scalar differ\n", cases[i], f,
+                        filterInstructions());
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    // A single wrong frame must not reach the output at all
+    struct filter_t spike;
+    filterParse(&spike, "median");
+    for (int i = 0; i < 5; i++) {
+        struct decoder_frame_t frame;
+        frameSet(&frame, (i == 2) ? 2100 : 1500);
+        filterApply(&spike, &frame, (uint64_t)i * PERIOD);
+        if (frame.channels[0] != 1500) {
+            fprintf(stderr, "Spike got through the median filter\n");
+            failed = 1;
+            break;
+        }
+    }
+
+    printf("%d channels, %s, %.1fms between frames\n", FILTER_CHANNELS, filterInstructions(),
+            PERIOD / 1e6);
+    printf("%-12s %8s %10s %10s %10s %10s\n", "", "", "ns/frame", "50% ms", "90% ms", "noise");
+    printf("%-12s %8s %10s %10s %10s %10.2f\n", "none", "", "", "0.0", "0.0", restNoise(NULL));
+    for (int i = 0; i < CASES; i++) {
+        for (int scalar = 0; scalar < 2; scalar++) {
+            struct filter_t f;
+            filterParse(&f, cases[i]);
+
+            unsigned long count = 0;
+            uint64_t time;
+            uint64_t start = latencyNow();
+            do {
+                for (int n = 0; n < STREAMFRAMES; n++) {
+                    struct decoder_frame_t frame = frames[n];
+                    if (scalar) {
+                        filterApplyScalar(&f, &frame, (count + n) * PERIOD);
+                    } else {
+                        filterApply(&f, &frame, (count + n) * PERIOD);
+                    }
+                    sink = frame.channels[n % IBUS_CHANNELS];
+                }
+                count += STREAMFRAMES;
+                time = latencyNow() - start;
+            } while (time < BENCHTIME);
+
+            if (scalar) {
+                printf("%-12s %8s %10.2f\n", "", "scalar", (double)time / count);
+            } else {
+                printf("%-12s %8s %10.2f %10.1f %10.1f %10.2f\n", cases[i], filterInstructions(),
+                        (double)time / count, stepFrames(cases[i], 50) * PERIOD / 1e6,
+                        stepFrames(cases[i], 90) * PERIOD / 1e6, restNoise(cases[i]));
+            }
+        }
+    }
+
+    free(frames);
+    return failed;
+}
+
@@ -0,0 +1,196 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Mailbox benchmark. One thread writes entries as fast as it can while
+ * other threads keep reading, like the serial thread and the GUI, with
+ * a mutex protected buffer for comparison. Every entry is checked for
+ * being torn, which must never happen.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "latency.h"
+#include "mailbox.h"
+
+#define BENCHTIME 200000000 // ns each case runs
+#define MAXREADERS 4
+
+enum buffer_t {
+    BUFFER_MAILBOX = 0,
+    BUFFER_MUTEX,
+
+    BUFFER_COUNT
+};
+
+static const char *bufferNames[BUFFER_COUNT] = {
+    [BUFFER_MAILBOX] = "mailbox",
+    [BUFFER_MUTEX] = "mutex",
+};
+
+static const int readerCounts[] = { 1, 3 };
+#define CASES (sizeof(readerCounts) / sizeof(readerCounts[0]))
+
+struct shared_t {
+    enum buffer_t buffer;
+    struct mailbox_t mailbox;
+    pthread_mutex_t mutex;
+    struct mailbox_entry_t locked; //!< protected by mutex
+    unsigned int lockedSequence;
+    atomic_int running;
+};
+
+struct reader_result_t {
+    unsigned long reads;
+    unsigned long torn; //!< entries not written like this
+    unsigned long backwards; //!< older entry than read before
+};
+
+struct reader_arg_t {
+    struct shared_t *shared;
+    struct reader_result_t result;
+};
+
+// Every field of entry n is derived from n, to find torn entries
+static void fill(struct mailbox_entry_t *entry, uint64_t n) {
+    for (int i = 0; i < DECODER_MAX_CHANNELS; i++) {
+        entry->frame.channels[i] = (uint16_t)(n + i);
+    }
+    entry->frame.count = (int)(n & 0x7FFFFFFF);
+    entry->frame.flags = (int)(n & 0xFF);
+    entry->time = n;
+}
+
+static int consistent(const struct mailbox_entry_t *entry) {
+    uint64_t n = entry->time;
+    for (int i = 0; i < DECODER_MAX_CHANNELS; i++) {
+        if (entry->frame.channels[i] != (uint16_t)(n + i)) {
+            return 0;
+        }
+    }
+    return (entry->frame.count == (int)(n & 0x7FFFFFFF)) && (entry->frame.flags == (int)(n & 0xFF));
+}
+
+static void bufferWrite(struct shared_t *s, const struct mailbox_entry_t *entry) {
+    if (s->buffer == BUFFER_MAILBOX) {
+        mailboxWrite(&s->mailbox, entry);
+    } else {
+        pthread_mutex_lock(&s->mutex);
+        s->locked = *entry;
+        s->lockedSequence++;
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
+
+static unsigned int bufferRead(struct shared_t *s, struct mailbox_entry_t *entry) {
+    if (s->buffer == BUFFER_MAILBOX) {
+        return mailboxRead(&s->mailbox, entry);
+    }
+
+    pthread_mutex_lock(&s->mutex);
+    *entry = s->locked;
+    unsigned int sequence = s->lockedSequence;
+    pthread_mutex_unlock(&s->mutex);
+    return sequence;
+}
+
+static void *readerThread(void *arg) {
+    struct reader_arg_t *r = arg;
+    struct mailbox_entry_t entry;
+    uint64_t previous = 0;
+
+    while (atomic_load_explicit(&r->shared->running, memory_order_relaxed)) {
+        if (bufferRead(r->shared, &entry) == 0) {
+            continue;
+        }
+        r->result.reads++;
+
+        if (!consistent(&entry)) {
+            r->result.torn++;
+        } else if (entry.time < previous) {
+            r->result.backwards++;
+        } else {
+            previous = entry.time;
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    int failed = 0;
+
+    printf("%-8s %7s %12s %10s %10s %10s %12s %10s\n", "", "readers", "writes/s",
+            "ns/write", "p99.9 ns", "max ns", "reads/s", "torn");
+    for (int b = 0; b < BUFFER_COUNT; b++) {
+        for (size_t c = 0; c < CASES; c++) {
+            struct shared_t shared;
+            memset(&shared, 0, sizeof(shared));
+            shared.buffer = b;
+            mailboxInit(&shared.mailbox);
+            pthread_mutex_init(&shared.mutex, NULL);
+            atomic_init(&shared.running, 1);
+
+            struct reader_arg_t readers[MAXREADERS];
+            pthread_t threads[MAXREADERS];
+            int count = readerCounts[c];
+            for (int i = 0; i < count; i++) {
+                memset(&readers[i].result, 0, sizeof(readers[i].result));
+                readers[i].shared = &shared;
+                if (pthread_create(&threads[i], NULL, readerThread, &readers[i]) != 0) {
+                    fprintf(stderr, "Couldn't start reader thread\n");
+                    return 1;
+                }
+            }
+
+            // The writer is timed per write, it must never wait for a reader
+            struct latency_histogram_t writeTime;
+            memset(&writeTime, 0, sizeof(writeTime));
+            struct mailbox_entry_t entry;
+            uint64_t writes = 0;
+            uint64_t start = latencyNow();
+            uint64_t now = start;
+            while ((now - start) < BENCHTIME) {
+                fill(&entry, ++writes);
+                bufferWrite(&shared, &entry);
+                uint64_t after = latencyNow();
+                latencyAdd(&writeTime, after - now);
+                now = after;
+            }
+            double seconds = (now - start) / 1e9;
+
+            atomic_store(&shared.running, 0);
+            struct reader_result_t total;
+            memset(&total, 0, sizeof(total));
+            for (int i = 0; i < count; i++) {
+                pthread_join(threads[i], NULL);
+                total.reads += readers[i].result.reads;
+                total.torn += readers[i].result.torn;
+                total.backwards += readers[i].result.backwards;
+            }
+            pthread_mutex_destroy(&shared.mutex);
+
+            printf("%-8s %7d %12.0f %10.1f %10.0f %10.0f %12.0f %10lu\n", bufferNames[b], count,
+                    writes / seconds, (now - start) / (double)writes,
+                    (double)latencyPercentile(&writeTime, 99.9), (double)writeTime.max,
+                    total.reads / seconds, total.torn);
+
+            if ((total.torn != 0) || (total.backwards != 0)) {
+                fprintf(stderr, "%s: %lu torn and %lu out of order entries\n", bufferNames[b],
+                        total.torn, total.backwards);
+                failed = 1;
+            }
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,226 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Serial reader benchmark. A thread writes numbered iBus frames into a
+ * pseudo terminal at a fixed rate, while the reader receives them with
+ * each backend. Prints the system calls per frame, the CPU time of the
+ * reading thread and the latency from writing a frame until it was
+ * decoded. Fails if a frame is lost.
+ *
+ * With -p the frames go through a real serial port instead, whose TX
+ * is connected to its RX, eg. with a jumper on a USB-serial adapter.
+ * The time on the wire is then part of the latency.
+ */
+
+#define _GNU_SOURCE // posix_openpt()
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "decoder.h"
+#include "latency.h"
+#include "reader.h"
+#include "stamp.h"
+
+#define FRAMES 3000 // frames sent to each backend
+#define RATE 1000 // frames per second, unless given with -r
+#define READTIMEOUT 2000000 // us without data until a case is given up
+
+struct writer_t {
+    int master;
+    uint64_t period; // ns between two frames
+    uint64_t times[FRAMES]; // latencyNow() before each frame was written
+};
+
+// Serial port looped back to itself, or NULL for a pseudo terminal
+static const char *port = NULL;
+static struct serial_config_t config;
+static uint64_t period = 1000000000 / RATE;
+
+// CPU time used by the calling thread, in ns
+static uint64_t cpuTime(void) {
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    return ((uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000)
+            + ((uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000);
+}
+
+static int openTerminal(int *master, char *path, size_t size) {
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((*master == -1) || (grantpt(*master) != 0) || (unlockpt(*master) != 0)) {
+        perror("Couldn't create pseudo terminal");
+        return -1;
+    }
+    snprintf(path, size, "%s", ptsname(*master));
+    return 0;
+}
+
+static void *writerRun(void *arg) {
+    struct writer_t *w = arg;
+    struct decoder_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.count = IBUS_CHANNELS;
+    for (int c = 0; c < IBUS_CHANNELS; c++) {
+        frame.channels[c] = 1500;
+    }
+
+    uint64_t start = latencyNow();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        uint64_t next = start + ((uint64_t)i * w->period);
+        uint64_t now = latencyNow();
+        if (next > now) {
+            struct timespec ts;
+            ts.tv_sec = (next - now) / 1000000000;
+            ts.tv_nsec = (next - now) % 1000000000;
+            nanosleep(&ts, NULL);
+        }
+
+        stampWrite(&frame, i, 0);
+        unsigned char data[DECODER_MAX_FRAME];
+        int length = decoderEncode(PROTOCOL_IBUS, &frame, data);
+        __atomic_store_n(&w->times[i], latencyNow(), __ATOMIC_RELEASE);
+        if (write(w->master, data, length) != length) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Runs one backend, returns 0 if all frames arrived
+static int runCase(const char *name, int uring, unsigned int spin, int pause) {
+    int master = -1;
+    char path[64];
+    if (port != NULL) {
+        snprintf(path, sizeof(path), "%s", port);
+    } else if (openTerminal(&master, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    struct reader_t *reader = malloc(sizeof(struct reader_t));
+    struct writer_t *writer = calloc(1, sizeof(struct writer_t));
+    if ((reader == NULL) || (writer == NULL)) {
+        return -1;
+    }
+    readerInit(reader);
+    reader->uring = uring;
+    reader->spin = spin;
+    reader->pause = pause;
+    if (readerOpen(reader, path, &config) != 0) {
+        return -1;
+    }
+    if (reader->uring != uring) {
+        printf("%-12s not available\n", name);
+        readerClose(reader);
+        if (master != -1) {
+            close(master);
+        }
+        return 0;
+    }
+
+    // The looped back port is written through the same file
+    writer->master = (master != -1) ? master : reader->fd;
+    writer->period = period;
+    pthread_t thread;
+    pthread_create(&thread, NULL, writerRun, writer);
+
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_IBUS);
+    struct latency_histogram_t latency;
+    memset(&latency, 0, sizeof(latency));
+    unsigned long received = 0;
+    unsigned char buffer[1024];
+    struct decoder_frame_t frames[32];
+    uint64_t wallStart = latencyNow();
+    uint64_t cpuStart = cpuTime();
+
+    while (received < FRAMES) {
+        int length = readerRead(reader, buffer, sizeof(buffer), serialTime() + READTIMEOUT);
+        if (length <= 0) {
+            break;
+        }
+
+        int count = decoderFeed(&decoder, buffer, length, frames, 32);
+        uint64_t now = latencyNow();
+        for (int f = 0; f < count; f++) {
+            uint32_t sequence;
+            uint64_t unused;
+            if ((stampRead(&frames[f], &sequence, &unused) == 0) && (sequence < FRAMES)) {
+                uint64_t sent = __atomic_load_n(&writer->times[sequence], __ATOMIC_ACQUIRE);
+                latencyAdd(&latency, (now > sent) ? (now - sent) : 0);
+                received++;
+            }
+        }
+    }
+
+    double cpu = 100.0 * (cpuTime() - cpuStart) / (latencyNow() - wallStart);
+    pthread_join(thread, NULL);
+    unsigned long syscalls = readerSyscalls(reader);
+    readerClose(reader);
+    if (master != -1) {
+        close(master);
+    }
+
+    printf("%-12s %8lu %12.2f %6.1f %10.1f %10.1f %10.1f %10.1f\n", name, received,
+            (received > 0) ? ((double)syscalls / received) : 0.0, cpu,
+            latencyPercentile(&latency, 50.0) / 1000.0,
+            latencyPercentile(&latency, 99.0) / 1000.0,
+            latencyPercentile(&latency, 99.9) / 1000.0,
+            latency.max / 1000.0);
+
+    free(writer);
+    free(reader);
+    if (received < FRAMES) {
+        fprintf(stderr, "%s: only %lu of %d frames received\n", name, received, FRAMES);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    serialDefaultConfig(&config, 115200);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:r:" SERIAL_OPTIONS)) != -1) {
+        if (opt == 'p') {
+            port = optarg;
+        } else if ((opt == 'r') && (atoi(optarg) > 0)) {
+            period = 1000000000 / atoi(optarg);
+        } else if (serialParseOption(&config, opt, optarg) != 1) {
+            fprintf(stderr, "Usage:\n\t%s [-p <looped back port> [-r <Hz>] [options]]\n", argv[0]);
+            fprintf(stderr, SERIAL_USAGE);
+            return 1;
+        }
+    }
+
+    printf("%d iBus frames at %.0fHz through %s\n", FRAMES, 1e9 / period,
+            (port != NULL) ? port : "a pseudo terminal");
+    printf("%-12s %8s %12s %6s %10s %10s %10s %10s\n", "", "frames", "syscalls", "cpu %",
+            "p50 us", "p99 us", "p99.9 us", "max us");
+
+    // Spinning for two frames never sleeps between them
+    unsigned int spin = 2 * period / 1000;
+
+    int failed = 0;
+    failed |= (runCase("poll", 0, 0, 0) != 0);
+    failed |= (runCase("io_uring", 1, 0, 0) != 0);
+    failed |= (runCase("spin", 0, spin, 0) != 0);
+    failed |= (runCase("spin, pause", 0, spin, 1) != 0);
+    return failed;
+}
+
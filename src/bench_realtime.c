@@ -0,0 +1,251 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Real-time mode benchmark. A high priority thread writes numbered iBus
+ * frames into a pseudo terminal, standing in for the receiver, while the
+ * reader receives them. This is repeated on an idle system, with one
+ * process per CPU spinning and churning memory, and with the same load
+ * after realtimeStart(). Prints the latency from writing a frame until
+ * its last byte was read, and the page faults and heap allocations of the
+ * process after the first frames. Fails if a frame is lost, or if real-time
+ * mode still faults or allocates after the first frames.
+ */
+
+#define _GNU_SOURCE // posix_openpt()
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "decoder.h"
+#include "latency.h"
+#include "reader.h"
+#include "realtime.h"
+#include "alloccount.h"
+#include "stamp.h"
+
+#define FRAMES 5000 // frames sent in each case
+#define PERIOD 1000000 // ns between two frames
+#define READTIMEOUT 2000000 // us without data until a case is given up
+#define CHURN (4 * 1024 * 1024) // bytes allocated and touched by each stress process
+#define MAXSTRESS 64
+
+struct writer_t {
+    int master;
+    int priority;
+    uint64_t times[FRAMES]; // latencyNow() before each frame was written
+};
+
+static int openTerminal(int *master, char *path, size_t size) {
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((*master == -1) || (grantpt(*master) != 0) || (unlockpt(*master) != 0)) {
+        perror("Couldn't create pseudo terminal");
+        return -1;
+    }
+    snprintf(path, size, "%s", ptsname(*master));
+    return 0;
+}
+
+static void *writerRun(void *arg) {
+    struct writer_t *w = arg;
+
+    // The receiver isn't slowed down by the load, so the writer shouldn't be either
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = w->priority;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    struct decoder_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.count = IBUS_CHANNELS;
+    for (int c = 0; c < IBUS_CHANNELS; c++) {
+        frame.channels[c] = 1500;
+    }
+
+    uint64_t start = latencyNow();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        uint64_t next = start + ((uint64_t)i * PERIOD);
+        uint64_t now = latencyNow();
+        if (next > now) {
+            struct timespec ts;
+            ts.tv_sec = (next - now) / 1000000000;
+            ts.tv_nsec = (next - now) % 1000000000;
+            nanosleep(&ts, NULL);
+        }
+
+        stampWrite(&frame, i, 0);
+        unsigned char data[DECODER_MAX_FRAME];
+        int length = decoderEncode(PROTOCOL_IBUS, &frame, data);
+        __atomic_store_n(&w->times[i], latencyNow(), __ATOMIC_RELEASE);
+        if (write(w->master, data, length) != length) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Spins and maps, touches and unmaps fresh memory, until killed
+static void stressRun(void) {
+    for (;;) {
+        unsigned char *p = malloc(CHURN);
+        if (p != NULL) {
+            memset(p, 0x55, CHURN);
+            free(p);
+        }
+    }
+}
+
+static int stressStart(pid_t *children) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = ((cpus > 0) && (cpus < MAXSTRESS)) ? (int)cpus : MAXSTRESS;
+    for (int i = 0; i < count; i++) {
+        children[i] = fork();
+        if (children[i] == 0) {
+            stressRun();
+        } else if (children[i] == -1) {
+            perror("Couldn't start stress process");
+            return i;
+        }
+    }
+    return count;
+}
+
+static void stressStop(pid_t *children, int count) {
+    for (int i = 0; i < count; i++) {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+}
+
+// Runs one case, returns 0 if all frames arrived
+static int runCase(const char *name, int stress, struct realtime_t *rt) {
+    int master;
+    char path[64];
+    if (openTerminal(&master, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    struct reader_t *reader = malloc(sizeof(struct reader_t));
+    struct writer_t *writer = calloc(1, sizeof(struct writer_t));
+    if ((reader == NULL) || (writer == NULL)) {
+        return -1;
+    }
+    readerInit(reader);
+    struct serial_config_t config;
+    serialDefaultConfig(&config, 115200);
+    if (readerOpen(reader, path, &config) != 0) {
+        return -1;
+    }
+
+    pid_t children[MAXSTRESS];
+    int stressing = stress ? stressStart(children) : 0;
+
+    if (rt != NULL) {
+        realtimeStart(rt);
+    }
+
+    writer->master = master;
+    writer->priority = ((rt != NULL) ? rt->priority : REALTIME_PRIORITY) + 10;
+    pthread_t thread;
+    pthread_create(&thread, NULL, writerRun, writer);
+
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_IBUS);
+    struct latency_histogram_t latency;
+    memset(&latency, 0, sizeof(latency));
+    struct realtime_t steady;
+    memset(&steady, 0, sizeof(steady));
+    long steadyAllocations = 0;
+    unsigned long received = 0;
+    unsigned char buffer[1024];
+    struct decoder_frame_t frames[32];
+
+    while (received < FRAMES) {
+        int length = readerRead(reader, buffer, sizeof(buffer), serialTime() + READTIMEOUT);
+        uint64_t now = latencyNow();
+        if (length <= 0) {
+            break;
+        }
+
+        int count = decoderFeed(&decoder, buffer, length, frames, 32);
+        for (int f = 0; f < count; f++) {
+            uint32_t sequence;
+            uint64_t unused;
+            if ((stampRead(&frames[f], &sequence, &unused) == 0) && (sequence < FRAMES)) {
+                uint64_t sent = __atomic_load_n(&writer->times[sequence], __ATOMIC_ACQUIRE);
+                latencyAdd(&latency, (now > sent) ? (now - sent) : 0);
+                received++;
+            }
+        }
+
+        if (!steady.steady && (received >= REALTIME_WARMUP)) {
+            realtimeSteady(&steady);
+            steadyAllocations = allocCount();
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long faults = usage.ru_minflt + usage.ru_majflt - steady.faults;
+    long allocations = allocCount() - steadyAllocations;
+
+    pthread_join(thread, NULL);
+    stressStop(children, stressing);
+    readerClose(reader);
+    close(master);
+
+    printf("%-16s %8lu %10.1f %10.1f %10.1f %10.1f %8ld %8ld\n", name, received,
+            latencyPercentile(&latency, 50.0) / 1000.0,
+            latencyPercentile(&latency, 99.0) / 1000.0,
+            latencyPercentile(&latency, 99.9) / 1000.0,
+            latency.max / 1000.0, faults, allocations);
+
+    free(writer);
+    free(reader);
+    if (received < FRAMES) {
+        fprintf(stderr, "%s: only %lu of %d frames received\n", name, received, FRAMES);
+        return -1;
+    }
+
+    // Without locked memory the kernel may take pages back at any time
+    if ((rt != NULL) && !rt->locked) {
+        fprintf(stderr, "%s: memory not locked, faults not checked\n", name);
+    } else if ((rt != NULL) && ((faults != 0) || (allocations != 0))) {
+        fprintf(stderr, "%s: %ld page faults and %ld allocations after the first frames\n",
+                name, faults, allocations);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    printf("%d iBus frames at %.0fHz through a pseudo terminal, %ld CPUs\n", FRAMES,
+            1e9 / PERIOD, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-16s %8s %10s %10s %10s %10s %8s %8s\n", "", "frames", "p50 us", "p99 us",
+            "p99.9 us", "max us", "faults", "allocs");
+
+    struct realtime_t rt;
+    realtimeParse(&rt, "0");
+
+    // Real-time mode can't be undone, so it comes last
+    int failed = 0;
+    failed |= (runCase("idle", 0, NULL) != 0);
+    failed |= (runCase("stress", 1, NULL) != 0);
+    failed |= (runCase("stress, realtime", 1, &rt) != 0);
+    return failed;
+}
+
@@ -0,0 +1,146 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decoder.h"
+
+#define SBUS_PACKETSIZE 25
+#define FRAMES 1024 // distinct random frames, fits into the L1 cache
+#define ITERATIONS 20000 // passes over all frames
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+// Reference implementation, shifting out one bit at a time
+static void unpackNaive(const unsigned char *data, uint16_t *channels) {
+    int byte = 0, bit = 0;
+    for (int c = 0; c < SBUS_CHANNELS; c++) {
+        uint16_t value = 0;
+        for (int i = 0; i < 11; i++) {
+            if (data[byte] & (1 << bit)) {
+                value |= 1 << i;
+            }
+            if (++bit == 8) {
+                bit = 0;
+                byte++;
+            }
+        }
+        channels[c] = value;
+    }
+}
+
+// The usual hand written shift/mask expression per channel
+static void unpackShift(const unsigned char *d, uint16_t *c) {
+    c[0]  = ((d[0]       | d[1] << 8)                  & 0x7FF);
+    c[1]  = ((d[1] >> 3  | d[2] << 5)                  & 0x7FF);
+    c[2]  = ((d[2] >> 6  | d[3] << 2 | d[4] << 10)     & 0x7FF);
+    c[3]  = ((d[4] >> 1  | d[5] << 7)                  & 0x7FF);
+    c[4]  = ((d[5] >> 4  | d[6] << 4)                  & 0x7FF);
+    c[5]  = ((d[6] >> 7  | d[7] << 1 | d[8] << 9)      & 0x7FF);
+    c[6]  = ((d[8] >> 2  | d[9] << 6)                  & 0x7FF);
+    c[7]  = ((d[9] >> 5  | d[10] << 3)                 & 0x7FF);
+    c[8]  = ((d[11]      | d[12] << 8)                 & 0x7FF);
+    c[9]  = ((d[12] >> 3 | d[13] << 5)                 & 0x7FF);
+    c[10] = ((d[13] >> 6 | d[14] << 2 | d[15] << 10)   & 0x7FF);
+    c[11] = ((d[15] >> 1 | d[16] << 7)                 & 0x7FF);
+    c[12] = ((d[16] >> 4 | d[17] << 4)                 & 0x7FF);
+    c[13] = ((d[17] >> 7 | d[18] << 1 | d[19] << 9)    & 0x7FF);
+    c[14] = ((d[19] >> 2 | d[20] << 6)                 & 0x7FF);
+    c[15] = ((d[20] >> 5 | d[21] << 3)                 & 0x7FF);
+}
+
+static double run(const char *name, void (*unpack)(const unsigned char *, uint16_t *),
+        unsigned char frames[][SBUS_PACKETSIZE], uint64_t *sum) {
+    uint16_t channels[SBUS_CHANNELS];
+    uint64_t start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int f = 0; f < FRAMES; f++) {
+            unpack(frames[f] + 1, channels);
+            *sum += channels[f % SBUS_CHANNELS];
+        }
+    }
+    double ns = (double)(now() - start) / ((double)ITERATIONS * FRAMES);
+    printf("%-8s %8.2f ns/frame %10.2f Mframes/s\n", name, ns, 1000.0 / ns);
+    return ns;
+}
+
+int main(int argc, char* argv[]) {
+    static unsigned char frames[FRAMES][SBUS_PACKETSIZE];
+    static unsigned char stream[FRAMES * SBUS_PACKETSIZE];
+
+    // Deterministic random channel data
+    uint32_t seed = 42;
+    for (int f = 0; f < FRAMES; f++) {
+        frames[f][0] = 0x0F;
+        for (int i = 1; i < (SBUS_PACKETSIZE - 1); i++) {
+            seed = (seed * 1103515245) + 12345;
+            frames[f][i] = seed >> 16;
+        }
+        frames[f][SBUS_PACKETSIZE - 2] &= 0x0F;
+        frames[f][SBUS_PACKETSIZE - 1] = 0x00;
+        memcpy(stream + (f * SBUS_PACKETSIZE), frames[f], SBUS_PACKETSIZE);
+    }
+
+    // All kernels have to agree
+    for (int f = 0; f < FRAMES; f++) {
+        uint16_t a[SBUS_CHANNELS], b[SBUS_CHANNELS], c[SBUS_CHANNELS];
+        unpackNaive(frames[f] + 1, a);
+        unpackShift(frames[f] + 1, b);
+        decoderUnpack11(frames[f] + 1, c);
+        if ((memcmp(a, b, sizeof(a)) != 0) || (memcmp(a, c, sizeof(a)) != 0)) {
+            fprintf(stderr, "Unpack mismatch in frame %d\n", f);
+            return 1;
+        }
+    }
+
+    // Only 0x00 and the four SBUS2 end bytes are accepted
+    const unsigned char ends[] = { 0x00, 0x04, 0x14, 0x24, 0x34, 0x44, 0x05, 0xF4 };
+    const int accepted[] = { 1, 1, 1, 1, 1, 0, 0, 0 };
+    for (size_t e = 0; e < sizeof(ends); e++) {
+        unsigned char frame[SBUS_PACKETSIZE];
+        memcpy(frame, frames[0], SBUS_PACKETSIZE);
+        frame[SBUS_PACKETSIZE - 1] = ends[e];
+        struct decoder_t decoder;
+        decoderInit(&decoder, PROTOCOL_SBUS);
+        struct decoder_frame_t out[2];
+        if (decoderFeed(&decoder, frame, SBUS_PACKETSIZE, out, 2) != accepted[e]) {
+            fprintf(stderr, "End byte 0x%02X %s\n", ends[e], accepted[e] ? "rejected" : "accepted");
+            return 1;
+        }
+    }
+
+    uint64_t sum = 0;
+    run("naive", unpackNaive, frames, &sum);
+    run("shift", unpackShift, frames, &sum);
+    run("word64", decoderUnpack11, frames, &sum);
+
+    // Complete decoder, including framing and scaling
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_SBUS);
+    struct decoder_frame_t out[64];
+    uint64_t start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        int n = decoderFeed(&decoder, stream, sizeof(stream), out, 64);
+        sum += out[n - 1].channels[0];
+    }
+    double ns = (double)(now() - start) / ((double)ITERATIONS * FRAMES);
+    printf("%-8s %8.2f ns/frame %10.2f Mframes/s (%lu frames)\n", "decoder", ns, 1000.0 / ns,
+            decoder.frames);
+
+    return (sum == 0) ? 1 : 0;
+}
+
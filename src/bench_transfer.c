@@ -0,0 +1,124 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Transfer function benchmark. Maps the same frames to reports with the
+ * lookup tables and by computing calibration, deadzone, expo and rate
+ * for every axis of every frame, and checks that both agree.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+#include "transfer.h"
+
+#define STREAMFRAMES 4096 // frames mapped in one pass
+#define BENCHTIME 200000000 // ns each case runs at least
+#define SEED 42
+
+static uint32_t random32(uint32_t *seed) {
+    *seed = (*seed * 1103515245) + 12345;
+    return *seed >> 8;
+}
+
+// Keeps the compiler from dropping the work
+static volatile int32_t sink;
+
+static void computeInline(const struct transfer_t *t, const struct decoder_frame_t *frame,
+        struct sink_report_t *report) {
+    for (int i = 0; i < SINK_AXES; i++) {
+        int channel = t->axes[i].channel;
+        int value = (channel < frame->count) ? frame->channels[channel] : t->axes[i].center;
+        report->axes[i] = transferCompute(&t->axes[i], value);
+    }
+    report->buttons = transferButtons(t, frame);
+}
+
+int main(int argc, char* argv[]) {
+    // A typical profile, with every part of the curve in use
+    struct transfer_t t;
+    transferInit(&t, PROTOCOL_IBUS);
+    for (int i = 0; i < SINK_AXES; i++) {
+        t.axes[i].minimum = 1000 + i;
+        t.axes[i].maximum = 2000 - i;
+        t.axes[i].deadzone = 8;
+        t.axes[i].expo = 30;
+        t.axes[i].rate = 90;
+    }
+    t.axes[SINK_LEFTY].reverse = 1;
+
+    uint64_t start = latencyNow();
+    transferBuild(&t);
+    uint64_t buildTime = latencyNow() - start;
+
+    // Random walk of all channels, with some values outside the calibration
+    struct decoder_frame_t *frames = malloc(STREAMFRAMES * sizeof(struct decoder_frame_t));
+    if (frames == NULL) {
+        return 1;
+    }
+    uint32_t seed = SEED;
+    int values[DECODER_MAX_CHANNELS];
+    for (int c = 0; c < DECODER_MAX_CHANNELS; c++) {
+        values[c] = 1500;
+    }
+    for (int f = 0; f < STREAMFRAMES; f++) {
+        for (int c = 0; c < DECODER_MAX_CHANNELS; c++) {
+            values[c] += (int)(random32(&seed) % 41) - 20;
+            if (values[c] < 950) {
+                values[c] = 950;
+            } else if (values[c] > 2050) {
+                values[c] = 2050;
+            }
+            frames[f].channels[c] = values[c];
+        }
+        frames[f].count = DECODER_MAX_CHANNELS;
+        frames[f].flags = 0;
+    }
+
+    // Both ways must give exactly the same reports
+    int failed = 0;
+    for (int f = 0; f < STREAMFRAMES; f++) {
+        struct sink_report_t a, b;
+        transferApply(&t, &frames[f], &a);
+        computeInline(&t, &frames[f], &b);
+        if (memcmp(&a, &b, sizeof(a)) != 0) {
+            fprintf(stderr, "Frame %d: table and inline computation differ\n", f);
+            failed = 1;
+            break;
+        }
+    }
+
+    printf("Building %d tables: %.1fus\n", SINK_AXES, buildTime / 1000.0);
+    printf("%-8s %10s %12s\n", "", "ns/frame", "frames/s");
+    for (int inlined = 0; inlined < 2; inlined++) {
+        unsigned long count = 0;
+        uint64_t time;
+        start = latencyNow();
+        do {
+            for (int f = 0; f < STREAMFRAMES; f++) {
+                struct sink_report_t report;
+                if (inlined) {
+                    computeInline(&t, &frames[f], &report);
+                } else {
+                    transferApply(&t, &frames[f], &report);
+                }
+                sink = report.axes[f % SINK_AXES];
+            }
+            count += STREAMFRAMES;
+            time = latencyNow() - start;
+        } while (time < BENCHTIME);
+
+        printf("%-8s %10.2f %12.0f\n", inlined ? "inline" : "table", (double)time / count,
+                count * 1e9 / time);
+    }
+
+    free(frames);
+    return failed;
+}
@@ -0,0 +1,295 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+#define WRITERINTERVAL 10000000 // ns the writer thread sleeps while the buffer is empty
+
+_Static_assert((sizeof(struct capture_header_t) % CAPTURE_ALIGN) == 0, "header breaks record alignment");
+_Static_assert((sizeof(struct capture_record_t) % CAPTURE_ALIGN) == 0, "record breaks data alignment");
+_Static_assert((CAPTURE_BUFFER & (CAPTURE_BUFFER - 1)) == 0, "buffer size must be a power of two");
+
+static size_t capturePadded(size_t length) {
+    return (length + CAPTURE_ALIGN - 1) & ~(size_t)(CAPTURE_ALIGN - 1);
+}
+
+static void *captureThread(void *arg) {
+    struct capture_t *c = arg;
+    int failed = 0;
+
+    for (;;) {
+        // Check this first, so everything queued before stopping is written
+        int running = atomic_load(&c->running);
+        size_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+
+        if (head == tail) {
+            if (!running) {
+                break;
+            }
+            struct timespec ts = { 0, WRITERINTERVAL };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        size_t start = tail & (CAPTURE_BUFFER - 1);
+        size_t count = head - tail;
+        if (count > (CAPTURE_BUFFER - start)) {
+            count = CAPTURE_BUFFER - start;
+        }
+
+        if (!failed) {
+            ssize_t ret = write(c->fd, c->buffer + start, count);
+            if (ret == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "Error writing capture file: %s\n", strerror(errno));
+                failed = 1;
+            } else {
+                count = ret;
+            }
+        }
+
+        // After an error everything is discarded, reading must go on
+        atomic_store_explicit(&c->tail, tail + count, memory_order_release);
+    }
+
+    return NULL;
+}
+
+int captureOpen(struct capture_t *c, const char *path, const struct serial_config_t *config) {
+    memset(c, 0, sizeof(struct capture_t));
+
+    c->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (c->fd == -1) {
+        fprintf(stderr, "Couldn't create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct capture_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.baud = config->baud;
+    header.dataBits = config->dataBits;
+    header.parity = config->parity;
+    header.stopBits = config->stopBits;
+
+    if (write(c->fd, &header, sizeof(header)) != sizeof(header)) {
+        fprintf(stderr, "Couldn't write %s: %s\n", path, strerror(errno));
+        close(c->fd);
+        return -1;
+    }
+
+    c->buffer = malloc(CAPTURE_BUFFER);
+    if (c->buffer == NULL) {
+        fprintf(stderr, "Not enough memory for capture buffer\n");
+        close(c->fd);
+        return -1;
+    }
+
+    atomic_init(&c->head, 0);
+    atomic_init(&c->tail, 0);
+    atomic_init(&c->running, 1);
+
+    if (pthread_create(&c->thread, NULL, captureThread, c) != 0) {
+        fprintf(stderr, "Couldn't start capture writer\n");
+        free(c->buffer);
+        close(c->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Copy into the ring buffer, wrapping around at its end
+static void captureCopy(struct capture_t *c, size_t pos, const void *data, size_t length) {
+    size_t start = pos & (CAPTURE_BUFFER - 1);
+    size_t first = CAPTURE_BUFFER - start;
+    if (first > length) {
+        first = length;
+    }
+
+    memcpy(c->buffer + start, data, first);
+    memcpy(c->buffer, (const unsigned char *)data + first, length - first);
+}
+
+void captureWrite(struct capture_t *c, uint64_t time, const unsigned char *data, int length) {
+    static const unsigned char padding[CAPTURE_ALIGN] = { 0 };
+
+    size_t padded = capturePadded(length);
+    size_t needed = sizeof(struct capture_record_t) + padded;
+    size_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&c->tail, memory_order_acquire);
+
+    if (needed > (CAPTURE_BUFFER - (head - tail))) {
+        c->overruns++;
+        return;
+    }
+
+    struct capture_record_t record;
+    record.time = time;
+    record.length = length;
+    record.reserved = 0;
+
+    captureCopy(c, head, &record, sizeof(record));
+    captureCopy(c, head + sizeof(record), data, length);
+    captureCopy(c, head + sizeof(record) + length, padding, padded - length);
+
+    atomic_store_explicit(&c->head, head + needed, memory_order_release);
+    c->records++;
+}
+
+void captureClose(struct capture_t *c) {
+    atomic_store(&c->running, 0);
+    pthread_join(c->thread, NULL);
+
+    close(c->fd);
+    free(c->buffer);
+
+    if (c->overruns > 0) {
+        fprintf(stderr, "Capture dropped %lu of %lu records\n", c->overruns,
+                c->records + c->overruns);
+    }
+}
+
+int replayOpen(struct replay_t *r, const char *path, int fast) {
+    memset(r, 0, sizeof(struct replay_t));
+    r->fast = fast;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) == -1) || (st.st_size < (off_t)sizeof(struct capture_header_t))) {
+        fprintf(stderr, "%s is no capture file\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    r->map = map;
+    r->size = st.st_size;
+    memcpy(&r->header, r->map, sizeof(r->header));
+    if (memcmp(r->header.magic, CAPTURE_MAGIC, sizeof(r->header.magic)) != 0) {
+        fprintf(stderr, "%s is no capture file\n", path);
+        replayClose(r);
+        return -1;
+    }
+
+    r->pos = sizeof(struct capture_header_t);
+    if ((r->pos + sizeof(struct capture_record_t)) <= r->size) {
+        memcpy(&r->first, r->map + r->pos, sizeof(r->first));
+    }
+
+    return 0;
+}
+
+void replayConfig(const struct replay_t *r, struct serial_config_t *config) {
+    config->baud = r->header.baud;
+    config->dataBits = r->header.dataBits;
+    config->parity = r->header.parity;
+    config->stopBits = r->header.stopBits;
+}
+
+// Get the header of the current record, -1 at the end or if it is truncated
+static int replayRecord(const struct replay_t *r, struct capture_record_t *record) {
+    if ((r->pos + sizeof(*record)) > r->size) {
+        return -1;
+    }
+
+    memcpy(record, r->map + r->pos, sizeof(*record));
+    if ((r->pos + sizeof(*record) + record->length) > r->size) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int replayWait(struct replay_t *r, uint64_t deadline) {
+    struct capture_record_t record;
+    if (replayRecord(r, &record) != 0) {
+        return -1;
+    }
+
+    if (r->fast) {
+        return 1;
+    }
+
+    uint64_t now = serialTime();
+    if (r->start == 0) {
+        r->start = now;
+    }
+
+    uint64_t due = r->start + (record.time - r->first);
+    if (due <= now) {
+        return 1;
+    }
+
+    uint64_t until = (due < deadline) ? due : deadline;
+    if (until > now) {
+        struct timespec ts;
+        ts.tv_sec = (until - now) / 1000000;
+        ts.tv_nsec = ((until - now) % 1000000) * 1000;
+        if (nanosleep(&ts, NULL) == -1) {
+            return 0;
+        }
+    }
+
+    return (due <= until) ? 1 : 0;
+}
+
+int replayRead(struct replay_t *r, unsigned char *data, int length, uint64_t deadline) {
+    int ret = replayWait(r, deadline);
+    if (ret != 1) {
+        return ret;
+    }
+
+    struct capture_record_t record;
+    replayRecord(r, &record);
+
+    size_t copy = record.length - r->offset;
+    if (copy > (size_t)length) {
+        copy = length;
+    }
+
+    memcpy(data, r->map + r->pos + sizeof(record) + r->offset, copy);
+    r->offset += copy;
+
+    if (r->offset >= record.length) {
+        r->pos += sizeof(record) + capturePadded(record.length);
+        r->offset = 0;
+    }
+
+    return copy;
+}
+
+void replayClose(struct replay_t *r) {
+    munmap((void *)r->map, r->size);
+}
+
@@ -0,0 +1,185 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "serial.h"
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Identifies capture files, the last byte is the format version.
+ */
+#define CAPTURE_MAGIC "SGCAPT\0\1"
+
+/*!
+ * \brief Size of the buffer between reading and the writer thread.
+ *
+ * Must be a power of two. One megabyte holds 25 seconds of CRSF
+ * at 420000 baud, plenty to ride out a slow disk.
+ */
+#define CAPTURE_BUFFER (1 << 20)
+
+/*!
+ * \brief Records are padded to this alignment in the file.
+ */
+#define CAPTURE_ALIGN 8
+
+/*
+ * File format
+ *
+ * A capture file starts with a capture_header_t, followed by any
+ * number of records. Each record is a capture_record_t followed by
+ * the received bytes, padded with zeros to CAPTURE_ALIGN, so the whole
+ * file can be mapped into memory and walked without copying. All
+ * fields are in host byte order. Files are only ever appended to.
+ */
+
+/*!
+ * \brief Start of every capture file.
+ */
+struct capture_header_t {
+    char magic[8]; //!< CAPTURE_MAGIC
+    uint32_t baud; //!< line settings of the captured port
+    uint8_t dataBits;
+    char parity;
+    uint8_t stopBits;
+    uint8_t reserved;
+};
+
+/*!
+ * \brief Start of every record in a capture file.
+ */
+struct capture_record_t {
+    uint64_t time; //!< serialTime() when read() returned, in microseconds
+    uint32_t length; //!< bytes returned by read()
+    uint32_t reserved;
+};
+
+/*!
+ * \brief Capture writer state.
+ *
+ * Reading only copies into a lock-free single producer, single
+ * consumer ring buffer. A background thread writes it to the file.
+ */
+struct capture_t {
+    int fd; //!< capture file
+    pthread_t thread; //!< background writer
+    atomic_int running; //!< cleared to stop the writer
+    unsigned char *buffer; //!< CAPTURE_BUFFER bytes
+    atomic_size_t head; //!< total bytes put into buffer
+    atomic_size_t tail; //!< total bytes written to the file
+    unsigned long records; //!< records put into buffer
+    unsigned long overruns; //!< records dropped, buffer was full
+};
+
+/*!
+ * \brief Replay source state.
+ */
+struct replay_t {
+    const unsigned char *map; //!< whole capture file
+    size_t size; //!< bytes in map
+    size_t pos; //!< offset of the current record
+    size_t offset; //!< bytes of the current record already returned
+    int fast; //!< ignore the captured timing
+    uint64_t start; //!< serialTime() when replaying started, 0 before
+    uint64_t first; //!< time of the first record
+    struct capture_header_t header;
+};
+
+/*
+ * Capturing
+ */
+
+/*!
+ * \brief create a capture file and start the writer thread
+ * \param c capture state to initialize
+ * \param path file to create, an existing file is overwritten
+ * \param config line settings to store in the file
+ * \returns 0 on success, -1 on error
+ */
+int captureOpen(struct capture_t *c, const char *path, const struct serial_config_t *config);
+
+/*!
+ * \brief queue received bytes for writing, never blocks
+ *
+ * If the writer thread can not keep up, the record is dropped and
+ * counted in overruns, so the file always stays consistent.
+ *
+ * \param c capture state
+ * \param time serialTime() when the bytes were read
+ * \param data received bytes
+ * \param length number of received bytes
+ */
+void captureWrite(struct capture_t *c, uint64_t time, const unsigned char *data, int length);
+
+/*!
+ * \brief write everything still buffered and close the file
+ * \param c capture state
+ */
+void captureClose(struct capture_t *c);
+
+/*
+ * Replaying
+ */
+
+/*!
+ * \brief map a capture file into memory
+ * \param r replay state to initialize
+ * \param path capture file to replay
+ * \param fast return data as fast as possible instead of with the captured timing
+ * \returns 0 on success, -1 on error
+ */
+int replayOpen(struct replay_t *r, const char *path, int fast);
+
+/*!
+ * \brief copy the captured line settings
+ * \param r replay state
+ * \param config settings to modify
+ */
+void replayConfig(const struct replay_t *r, struct serial_config_t *config);
+
+/*!
+ * \brief wait until the next record is due
+ * \param r replay state
+ * \param deadline when to give up, see serialTime()
+ * \returns 1 if data is available, 0 on timeout or signal, -1 at the end of the file
+ */
+int replayWait(struct replay_t *r, uint64_t deadline);
+
+/*!
+ * \brief get the bytes of the next record, like serialRead()
+ *
+ * Returns at most one record per call, so the decoders see the
+ * same chunks they saw while capturing.
+ *
+ * \param r replay state
+ * \param data buffer receiving the data
+ * \param length size of data
+ * \param deadline when to give up, see serialTime()
+ * \returns number of bytes read, 0 on timeout or signal, -1 at the end of the file
+ */
+int replayRead(struct replay_t *r, unsigned char *data, int length, uint64_t deadline);
+
+/*!
+ * \brief unmap the capture file
+ * \param r replay state
+ */
+void replayClose(struct replay_t *r);
+
+#endif
+
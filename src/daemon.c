@@ -0,0 +1,524 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Receiver daemon. Serves any number of serial ports from one event loop,
+ * epoll on Linux and poll() elsewhere, or from a few pinned worker threads
+ * with one loop each. Every port has its own decoder, profile, filter and
+ * virtual gamepad, numbered in the order the ports were given.
+ */
+
+#define _GNU_SOURCE // pthread_setaffinity_np()
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "serial.h"
+#include "decoder.h"
+#include "latency.h"
+#include "sink.h"
+#include "transfer.h"
+#include "filter.h"
+
+#define BAUDRATE 115200
+#define MAXPORTS 256
+#define MAXTHREADS 16
+#define FRAMES 32
+#define BUFFERSIZE 1024
+#define READTIMEOUT 100 // ms, only bounds the reaction time to signals
+
+// One receiver and its virtual gamepad
+struct port_t {
+    const char *path;
+    int fd; // -1 after the port was lost
+    struct detector_t detector;
+    struct decoder_t fixed;
+    struct decoder_t *decoder; // NULL until the protocol is detected
+    unsigned long checksumErrors; // last value printed
+    int failsafe;
+    struct transfer_t transfer;
+    struct filter_t filter;
+    struct sink_t sink;
+    struct latency_histogram_t latency; // readable until the report was sent
+};
+
+// One event loop and the ports it serves
+struct worker_t {
+    int number;
+    pthread_t thread;
+    struct port_t *ports[MAXPORTS];
+    int count;
+#ifdef __linux__
+    int epoll;
+#else
+    struct pollfd fds[MAXPORTS];
+#endif
+    unsigned long wakeups; // returns from waiting with at least one port ready
+    unsigned long events; // ready ports over all wakeups
+};
+
+static volatile sig_atomic_t running = 1;
+static const char *profile = NULL;
+static bool detect = true;
+static enum decoder_protocol_t protocol = PROTOCOL_CT6B;
+static bool filtering = false;
+static bool measure = false;
+static bool pin = false;
+
+static void signalHandler(int signo) {
+    running = 0;
+}
+
+// Calibration of a protocol, changed by the profile, computed into tables
+static int daemonTransfer(struct transfer_t *t, enum decoder_protocol_t p) {
+    transferInit(t, p);
+    if ((profile != NULL) && (transferLoad(t, profile) != 0)) {
+        return -1;
+    }
+    transferBuild(t);
+    return 0;
+}
+
+// Decode, filter, map and send everything read from a port in one go
+static void portFeed(struct port_t *port, const unsigned char *data, int length, uint64_t readable) {
+    struct decoder_frame_t frames[FRAMES];
+    int count;
+    if (port->decoder == NULL) {
+        count = detectorFeed(&port->detector, data, length, frames, FRAMES);
+        port->decoder = detectorDecoder(&port->detector);
+        if (port->decoder == NULL) {
+            return;
+        }
+
+        daemonTransfer(&port->transfer, port->decoder->protocol);
+        filterReset(&port->filter);
+        printf("%s: detected %s\n", port->path, decoderName(port->decoder->protocol));
+    } else {
+        count = decoderFeed(port->decoder, data, length, frames, FRAMES);
+    }
+
+    if (port->decoder->checksumErrors != port->checksumErrors) {
+        printf("%s: bad checksum (%lu total, %lu frames recovered)\n", port->path,
+                port->decoder->checksumErrors, port->decoder->resyncs);
+        port->checksumErrors = port->decoder->checksumErrors;
+    }
+
+    for (int f = 0; f < count; f++) {
+        if ((frames[f].flags & DECODER_FLAG_FAILSAFE) != port->failsafe) {
+            port->failsafe = frames[f].flags & DECODER_FLAG_FAILSAFE;
+            printf("%s: receiver failsafe %s\n", port->path, port->failsafe ? "active" : "cleared");
+        }
+
+        if (filtering) {
+            filterApply(&port->filter, &frames[f], readable);
+        }
+
+        struct sink_report_t report;
+        transferApply(&port->transfer, &frames[f], &report);
+        sinkSend(&port->sink, &report);
+
+        if (measure) {
+            latencyAdd(&port->latency, latencyNow() - readable);
+        }
+    }
+}
+
+// Read once from a ready port, level triggered waiting reports leftovers again.
+// Returns -1 if the port is gone and has to be removed from the loop.
+static int portRead(struct port_t *port, unsigned char *buffer, uint64_t readable) {
+    ssize_t length = read(port->fd, buffer, BUFFERSIZE);
+    if (length > 0) {
+        portFeed(port, buffer, length, readable);
+        return 0;
+    }
+    if ((length == -1) && ((errno == EAGAIN) || (errno == EINTR))) {
+        return 0;
+    }
+
+    fprintf(stderr, "%s: lost port: %s\n", port->path, (length == 0) ? "end of file" : strerror(errno));
+    return -1;
+}
+
+static int workerInit(struct worker_t *w) {
+#ifdef __linux__
+    w->epoll = epoll_create1(0);
+    if (w->epoll == -1) {
+        perror("Couldn't create epoll instance");
+        return -1;
+    }
+    for (int i = 0; i < w->count; i++) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = w->ports[i];
+        if (epoll_ctl(w->epoll, EPOLL_CTL_ADD, w->ports[i]->fd, &event) == -1) {
+            perror("Couldn't add port to epoll instance");
+            return -1;
+        }
+    }
+#else
+    for (int i = 0; i < w->count; i++) {
+        w->fds[i].fd = w->ports[i]->fd;
+        w->fds[i].events = POLLIN;
+    }
+#endif
+    return 0;
+}
+
+// Stop waiting for a port that failed, the others keep running
+static void workerRemove(struct worker_t *w, struct port_t *port) {
+#ifdef __linux__
+    epoll_ctl(w->epoll, EPOLL_CTL_DEL, port->fd, NULL);
+#else
+    for (int i = 0; i < w->count; i++) {
+        if (w->ports[i] == port) {
+            w->fds[i].fd = -1;
+        }
+    }
+#endif
+    serialClose(port->fd);
+    port->fd = -1;
+}
+
+static void *workerRun(void *arg) {
+    struct worker_t *w = arg;
+
+#ifdef __linux__
+    if (pin) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(w->number % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0) {
+            fprintf(stderr, "Couldn't pin worker %d: %s\n", w->number, strerror(ret));
+        }
+    }
+#endif
+
+    unsigned char buffer[BUFFERSIZE];
+    while (running) {
+#ifdef __linux__
+        struct epoll_event events[MAXPORTS];
+        int ready = epoll_wait(w->epoll, events, MAXPORTS, READTIMEOUT);
+#else
+        int ready = poll(w->fds, w->count, READTIMEOUT);
+#endif
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error while waiting for ports");
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        // All ports ready at once share the wakeup and the clock read
+        uint64_t readable = latencyNow();
+        w->wakeups++;
+        w->events += ready;
+
+#ifdef __linux__
+        for (int i = 0; i < ready; i++) {
+            struct port_t *port = events[i].data.ptr;
+            if (portRead(port, buffer, readable) != 0) {
+                workerRemove(w, port);
+            }
+        }
+#else
+        for (int i = 0; i < w->count; i++) {
+            if ((w->fds[i].fd != -1) && (w->fds[i].revents != 0)
+                    && (portRead(w->ports[i], buffer, readable) != 0)) {
+                workerRemove(w, w->ports[i]);
+            }
+        }
+#endif
+    }
+
+    return NULL;
+}
+
+static void statisticsPrint(struct port_t *ports, int count, struct worker_t *workers, int threads) {
+    unsigned long frames = 0, reports = 0, suppressed = 0;
+    for (int i = 0; i < count; i++) {
+        struct port_t *port = &ports[i];
+        unsigned long decoded = (port->decoder != NULL) ? port->decoder->frames : 0;
+        frames += decoded;
+        reports += port->sink.reports;
+        suppressed += port->sink.suppressed;
+        printf("%s: %s, %lu frames, %lu bad checksums, latency p50 %.1fus p99 %.1fus max %.1fus\n",
+                port->path, (port->decoder != NULL) ? decoderName(port->decoder->protocol) : "nothing detected",
+                decoded, (port->decoder != NULL) ? port->decoder->checksumErrors : 0,
+                latencyPercentile(&port->latency, 50.0) / 1000.0,
+                latencyPercentile(&port->latency, 99.0) / 1000.0,
+                port->latency.max / 1000.0);
+    }
+
+    unsigned long wakeups = 0, events = 0;
+    for (int i = 0; i < threads; i++) {
+        wakeups += workers[i].wakeups;
+        events += workers[i].events;
+    }
+    printf("%d ports, %d threads: %lu frames, %lu reports, %lu suppressed, %lu wakeups, %.2f ports per wakeup\n",
+            count, threads, frames, reports, suppressed, wakeups,
+            (wakeups > 0) ? ((double)events / wakeups) : 0.0);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double user = (usage.ru_utime.tv_sec * 1e3) + (usage.ru_utime.tv_usec / 1e3);
+    double system = (usage.ru_stime.tv_sec * 1e3) + (usage.ru_stime.tv_usec / 1e3);
+    printf("CPU time: %.1fms user, %.1fms system, %.2fus per frame\n", user, system,
+            (frames > 0) ? ((user + system) * 1e3 / frames) : 0.0);
+}
+
+int main(int argc, char* argv[]) {
+    const char *paths[MAXPORTS];
+    int count = 0;
+    struct serial_config_t config;
+    serialDefaultConfig(&config, 0);
+    bool formatSet = false;
+    const char *sinkName = NULL;
+    const char *deadband = NULL;
+    unsigned int keepAlive = SINK_KEEPALIVE;
+    struct filter_t filter;
+    int threads = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:do:z:k:P:F:T:6iscL" SERIAL_OPTIONS)) != EOF) {
+        switch (opt) {
+        case 'p':
+            if (count >= MAXPORTS) {
+                fprintf(stderr, "At most %d ports are supported\n", MAXPORTS);
+                exit(1);
+            }
+            paths[count++] = optarg;
+            break;
+        case 'd':
+            sinkName = "debug";
+            break;
+        case 'o':
+            sinkName = optarg;
+            break;
+        case 'z':
+            deadband = optarg;
+            break;
+        case 'k':
+            keepAlive = atoi(optarg);
+            break;
+        case 'P':
+            profile = optarg;
+            break;
+        case 'F':
+            if (filterParse(&filter, optarg) != 0) {
+                fprintf(stderr, "Invalid filter %s\n", optarg);
+                exit(1);
+            }
+            filtering = true;
+            break;
+        case 'T':
+            threads = atoi(optarg);
+            if ((threads < 1) || (threads > MAXTHREADS)) {
+                fprintf(stderr, "Threads -T must be 1 - %d\n", MAXTHREADS);
+                exit(1);
+            }
+            pin = true;
+            break;
+        case '6':
+            protocol = PROTOCOL_CT6B;
+            detect = false;
+            break;
+        case 'i':
+            protocol = PROTOCOL_IBUS;
+            detect = false;
+            break;
+        case 's':
+            protocol = PROTOCOL_SBUS;
+            detect = false;
+            break;
+        case 'c':
+            protocol = PROTOCOL_CRSF;
+            detect = false;
+            break;
+        case 'L':
+            measure = true;
+            break;
+        default:
+            if (serialParseOption(&config, opt, optarg) != 1) {
+                fprintf(stderr, "Usage:\n\t%s -p <port> [-p <port> ...] [-d | -o <sink>] [-P <profile>] [-F <filters>] [-z <deadband>] [-T <threads>] [-L] [-6 | -i | -s | -c] [options]\n", argv[0]);
+                fprintf(stderr, "\t-p <port>  serial port of a receiver, up to %d, each gets its own device\n", MAXPORTS);
+                fprintf(stderr, "\t-d         debug mode, print values instead of sending\n");
+                fprintf(stderr, "\t-o <sink>  output to one of: %s\n", sinkNames());
+                fprintf(stderr, "\t-P <file>  channel mapping, calibration and curves of axes and buttons\n");
+                fprintf(stderr, "\t-F <list>  filter the channels with median, euro[=<Hz>[:<beta>]] or both\n");
+                fprintf(stderr, "\t-z <band>  skip reports without changes larger than band\n");
+                fprintf(stderr, "\t-k <ms>    send unchanged reports after this time, default %d\n", SINK_KEEPALIVE);
+                fprintf(stderr, "\t-T <n>     serve the ports from n worker threads, pinned to CPUs\n");
+                fprintf(stderr, "\t-L         print statistics and CPU time on exit\n");
+                fprintf(stderr, "\t-6         CT6B protocol, detected automatically by default,\n");
+                fprintf(stderr, "\t           at the line settings of CT6B and iBus unless given\n");
+                fprintf(stderr, "\t-i         iBus protocol\n");
+                fprintf(stderr, "\t-s         SBUS protocol\n");
+                fprintf(stderr, "\t-c         CRSF / ExpressLRS protocol\n");
+                fprintf(stderr, "Options:\n" SERIAL_USAGE);
+                exit(1);
+            }
+            if (opt == 'f') {
+                formatSet = true;
+            }
+            break;
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "At least one serial port -p <port> must be specified\n");
+        exit(1);
+    }
+    if (threads > count) {
+        threads = count;
+    }
+
+    struct sink_t *backend = sinkFind(sinkName);
+    if (backend == NULL) {
+        fprintf(stderr, "Unknown sink %s, use one of: %s\n", sinkName, sinkNames());
+        exit(1);
+    }
+    if ((deadband != NULL) && (sinkSuppress(backend, deadband, keepAlive) != 0)) {
+        fprintf(stderr, "Invalid deadband %s\n", deadband);
+        exit(1);
+    }
+
+    // All ports share the line settings, detection doesn't cycle through them
+    if (config.baud == 0) {
+        config.baud = (protocol == PROTOCOL_SBUS) ? 100000 : ((protocol == PROTOCOL_CRSF) ? 420000 : BAUDRATE);
+    }
+    if (!formatSet) {
+        serialParseFormat(&config, (protocol == PROTOCOL_SBUS) ? "8E2" : "8N1");
+    }
+
+    // Each port keeps a few kB of tables and histograms
+    struct port_t *ports = calloc(count, sizeof(struct port_t));
+    struct worker_t *workers = calloc(threads, sizeof(struct worker_t));
+    if ((ports == NULL) || (workers == NULL)) {
+        fprintf(stderr, "Not enough memory for %d ports\n", count);
+        exit(1);
+    }
+
+    // Also checks the profile, before anything is opened.
+    // The layout doesn't depend on the protocol, detection can't change it.
+    if (daemonTransfer(&ports[0].transfer, protocol) != 0) {
+        exit(1);
+    }
+    struct sink_layout_t layout;
+    transferLayout(&ports[0].transfer, &layout);
+
+    int opened = 0;
+    for (; opened < count; opened++) {
+        struct port_t *port = &ports[opened];
+        port->path = paths[opened];
+        port->fd = serialOpenConfig(port->path, &config);
+        if (port->fd == -1) {
+            break;
+        }
+
+        detectorInit(&port->detector);
+        decoderInit(&port->fixed, protocol);
+        port->decoder = detect ? NULL : &port->fixed;
+        port->transfer = ports[0].transfer;
+        if (filtering) {
+            port->filter = filter;
+        }
+
+        sinkInstance(&port->sink, backend, opened + 1);
+        if (sinkOpen(&port->sink, &layout) != 0) {
+            fprintf(stderr, "failed to init %s for %s\n", port->sink.name, port->path);
+            serialClose(port->fd);
+            break;
+        }
+    }
+    if (opened < count) {
+        for (int i = 0; i < opened; i++) {
+            sinkClose(&ports[i].sink);
+            serialClose(ports[i].fd);
+        }
+        exit(1);
+    }
+
+    if ((signal(SIGINT, signalHandler) == SIG_ERR) || (signal(SIGTERM, signalHandler) == SIG_ERR)) {
+        perror("Couldn't register signal handler");
+        return 1;
+    }
+
+    // Round robin, so ports given next to each other are spread over the threads
+    for (int i = 0; i < count; i++) {
+        struct worker_t *w = &workers[i % threads];
+        w->ports[w->count++] = &ports[i];
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i].number = i;
+        if (workerInit(&workers[i]) != 0) {
+            exit(1);
+        }
+    }
+
+    if (detect) {
+        printf("Serving %d ports with %d threads, detecting protocol...\n", count, threads);
+    } else {
+        printf("Serving %d ports with %d threads (%s)...\n", count, threads, decoderName(protocol));
+    }
+
+    // The first loop runs in the main thread
+    int started = 1;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started].thread, NULL, workerRun, &workers[started]) != 0) {
+            fprintf(stderr, "Couldn't start worker thread\n");
+            running = 0;
+            break;
+        }
+    }
+    workerRun(&workers[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    if (measure) {
+        statisticsPrint(ports, count, workers, threads);
+    }
+
+    printf("Closing serial ports...\n");
+    for (int i = 0; i < count; i++) {
+        if (ports[i].fd != -1) {
+            serialClose(ports[i].fd);
+        }
+        sinkClose(&ports[i].sink);
+    }
+#ifdef __linux__
+    for (int i = 0; i < threads; i++) {
+        close(workers[i].epoll);
+    }
+#endif
+    free(workers);
+    free(ports);
+
+    return 0;
+}
+
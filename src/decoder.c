@@ -0,0 +1,601 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "decoder.h"
+
+#define CT6B_PACKETSIZE 18
+#define CT6B_HEADERBYTE_A 0x55
+#define CT6B_HEADERBYTE_B 0xFC
+#define CT6B_PAYLOADBYTES 14
+#define CT6B_TESTCHANNEL 2
+
+#define IBUS_PACKETSIZE 32
+#define IBUS_HEADERBYTE_A 0x20
+#define IBUS_HEADERBYTE_B 0x40
+
+#define SBUS_PACKETSIZE 25
+#define SBUS_HEADERBYTE 0x0F
+#define SBUS_DATABYTES 22
+#define SBUS_FLAG_CH17 (1 << 0)
+#define SBUS_FLAG_CH18 (1 << 1)
+#define SBUS_FLAG_FRAMELOST (1 << 2)
+#define SBUS_FLAG_FAILSAFE (1 << 3)
+
+#define CRSF_SYNCBYTE 0xC8 // Address of the flight controller
+#define CRSF_MINLENGTH 2 // Type and CRC
+#define CRSF_MAXLENGTH 62
+#define CRSF_TYPE_LINK 0x14
+#define CRSF_TYPE_CHANNELS 0x16
+#define CRSF_LINKBYTES 10
+#define CRSF_CHANNELBYTES 22
+#define CRSF_POLYNOMIAL 0xD5
+
+// Results of protocol_t.parse()
+enum parse_result_t {
+    PARSE_INVALID = 0, // wrong checksum
+    PARSE_FRAME, // channel data stored in frame
+    PARSE_OTHER, // valid, but no channel data
+};
+
+/*
+ * Describes the framing of one protocol. All frames start with
+ * a fixed header, the first byte of which is searched using memchr().
+ */
+struct protocol_t {
+    const char *name;
+    unsigned char header[2];
+    int headerLength;
+    int frameLength; // fixed size, or bytes needed to call frameSize()
+
+    // Size of variable length frame p, or -1 if it can't be a frame
+    int (*frameSize)(const unsigned char *p);
+
+    // Checks the checksum (or end byte) of frame p and fills f
+    enum parse_result_t (*parse)(struct decoder_t *d, const unsigned char *p,
+            struct decoder_frame_t *f);
+};
+
+static enum parse_result_t parseCT6B(struct decoder_t *d, const unsigned char *p,
+        struct decoder_frame_t *f) {
+    const unsigned char *payload = p + 2;
+
+    uint16_t checksum = 0;
+    for (int i = 0; i < CT6B_PAYLOADBYTES; i++) {
+        checksum += payload[i];
+    }
+
+    if (checksum != ((payload[CT6B_PAYLOADBYTES] << 8) | payload[CT6B_PAYLOADBYTES + 1])) {
+        return PARSE_INVALID;
+    }
+
+    for (int i = 0; i < CT6B_CHANNELS; i++) {
+        f->channels[i] = (payload[2 * i] << 8) | payload[(2 * i) + 1];
+    }
+    f->count = CT6B_CHANNELS;
+
+    // The seventh value should mirror the test channel
+    uint16_t test = (payload[2 * CT6B_CHANNELS] << 8) | payload[(2 * CT6B_CHANNELS) + 1];
+    f->flags = (test != f->channels[CT6B_TESTCHANNEL]) ? DECODER_FLAG_TESTCHANNEL : 0;
+
+    return PARSE_FRAME;
+}
+
+static enum parse_result_t parseIBUS(struct decoder_t *d, const unsigned char *p,
+        struct decoder_frame_t *f) {
+    unsigned int checksum = 0xFFFF;
+    for (int i = 0; i < (IBUS_PACKETSIZE - 2); i++) {
+        checksum -= p[i];
+    }
+
+    if (checksum != (p[IBUS_PACKETSIZE - 2] | (p[IBUS_PACKETSIZE - 1] << 8))) {
+        return PARSE_INVALID;
+    }
+
+    for (int i = 0; i < IBUS_CHANNELS; i++) {
+        f->channels[i] = p[2 + (2 * i)] | (p[3 + (2 * i)] << 8);
+    }
+    f->count = IBUS_CHANNELS;
+    f->flags = 0;
+
+    return PARSE_FRAME;
+}
+
+/*
+ * Load 8 bytes as little endian word. memcpy() compiles to a single
+ * unaligned load on all relevant platforms.
+ */
+static inline uint64_t load64(const unsigned char *p) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+#endif
+}
+
+/*
+ * Every 11 bytes hold 8 channels. The first 5 of them are inside
+ * bytes 0 to 7, the remaining 3 inside bytes 3 to 10, so both words
+ * stay inside of the group.
+ */
+static inline void unpack8(const unsigned char *p, uint16_t *c) {
+    uint64_t lo = load64(p);
+    uint64_t hi = load64(p + 3);
+
+    c[0] = lo & 0x7FF;
+    c[1] = (lo >> 11) & 0x7FF;
+    c[2] = (lo >> 22) & 0x7FF;
+    c[3] = (lo >> 33) & 0x7FF;
+    c[4] = (lo >> 44) & 0x7FF;
+    c[5] = (hi >> 31) & 0x7FF;
+    c[6] = (hi >> 42) & 0x7FF;
+    c[7] = (hi >> 53) & 0x7FF;
+}
+
+void decoderUnpack11(const unsigned char *data, uint16_t *channels) {
+    unpack8(data, channels);
+    unpack8(data + 11, channels + 8);
+}
+
+static enum parse_result_t parseSBUS(struct decoder_t *d, const unsigned char *p,
+        struct decoder_frame_t *f) {
+    // There is no checksum, only the end byte can be verified.
+    // SBUS2 receivers use 0x04, 0x14, 0x24 and 0x34 there.
+    unsigned char end = p[SBUS_PACKETSIZE - 1];
+    if ((end != 0x00) && ((end & 0xCF) != 0x04)) {
+        return PARSE_INVALID;
+    }
+
+    decoderUnpack11(p + 1, f->channels);
+
+    // Scale 172 - 1811 to 987 - 2011, like the servo outputs of the receiver
+    for (int i = 0; i < SBUS_CHANNELS; i++) {
+        f->channels[i] = 880 + ((f->channels[i] * 5) >> 3);
+    }
+    f->count = SBUS_CHANNELS;
+
+    unsigned char flags = p[1 + SBUS_DATABYTES];
+    f->flags = 0;
+    if (flags & SBUS_FLAG_CH17) {
+        f->flags |= DECODER_FLAG_CH17;
+    }
+    if (flags & SBUS_FLAG_CH18) {
+        f->flags |= DECODER_FLAG_CH18;
+    }
+    if (flags & SBUS_FLAG_FRAMELOST) {
+        f->flags |= DECODER_FLAG_FRAMELOST;
+    }
+    if (flags & SBUS_FLAG_FAILSAFE) {
+        f->flags |= DECODER_FLAG_FAILSAFE;
+    }
+
+    return PARSE_FRAME;
+}
+
+/*
+ * crcTable[0] is the usual byte-wise table. crcTable[k][x] is the CRC
+ * of x followed by k zero bytes. As the CRC is linear, eight bytes can
+ * then be processed with eight independent lookups.
+ */
+static uint8_t crcTable[8][256];
+static int crcTableReady = 0;
+
+static void crcInit(void) {
+    if (crcTableReady) {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t crc = i;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? ((crc << 1) ^ CRSF_POLYNOMIAL) : (crc << 1);
+        }
+        crcTable[0][i] = crc;
+    }
+
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            crcTable[k][i] = crcTable[0][crcTable[k - 1][i]];
+        }
+    }
+
+    crcTableReady = 1;
+}
+
+uint8_t decoderCrc8(const unsigned char *data, int length) {
+    uint8_t crc = 0;
+
+    crcInit();
+
+    while (length >= 8) {
+        crc = crcTable[7][crc ^ data[0]] ^ crcTable[6][data[1]]
+            ^ crcTable[5][data[2]] ^ crcTable[4][data[3]]
+            ^ crcTable[3][data[4]] ^ crcTable[2][data[5]]
+            ^ crcTable[1][data[6]] ^ crcTable[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length-- > 0) {
+        crc = crcTable[0][crc ^ *(data++)];
+    }
+
+    return crc;
+}
+
+static int frameSizeCRSF(const unsigned char *p) {
+    int length = p[1];
+    if ((length < CRSF_MINLENGTH) || (length > CRSF_MAXLENGTH)) {
+        return -1;
+    }
+    return length + 2;
+}
+
+static enum parse_result_t parseCRSF(struct decoder_t *d, const unsigned char *p,
+        struct decoder_frame_t *f) {
+    int length = p[1];
+    const unsigned char *payload = p + 3;
+    int payloadLength = length - 2;
+
+    // CRC covers type and payload
+    if (decoderCrc8(p + 2, length - 1) != p[length + 1]) {
+        return PARSE_INVALID;
+    }
+
+    if ((p[2] == CRSF_TYPE_CHANNELS) && (payloadLength == CRSF_CHANNELBYTES)) {
+        decoderUnpack11(payload, f->channels);
+
+        // Scale 172 - 1811 to 987 - 2011, same as SBUS
+        for (int i = 0; i < CRSF_CHANNELS; i++) {
+            f->channels[i] = 880 + ((f->channels[i] * 5) >> 3);
+        }
+        f->count = CRSF_CHANNELS;
+        f->flags = 0;
+        return PARSE_FRAME;
+    } else if ((p[2] == CRSF_TYPE_LINK) && (payloadLength >= CRSF_LINKBYTES)) {
+        d->link.uplinkRssi1 = payload[0];
+        d->link.uplinkRssi2 = payload[1];
+        d->link.uplinkQuality = payload[2];
+        d->link.uplinkSnr = (int8_t)payload[3];
+        d->link.activeAntenna = payload[4];
+        d->link.rfMode = payload[5];
+        d->link.uplinkTxPower = payload[6];
+        d->link.downlinkRssi = payload[7];
+        d->link.downlinkQuality = payload[8];
+        d->link.downlinkSnr = (int8_t)payload[9];
+        d->linkFrames++;
+    }
+
+    return PARSE_OTHER;
+}
+
+static const struct protocol_t protocols[PROTOCOL_COUNT] = {
+    [PROTOCOL_CT6B] = {
+        "CT6B", { CT6B_HEADERBYTE_A, CT6B_HEADERBYTE_B }, 2, CT6B_PACKETSIZE, NULL, parseCT6B
+    },
+    [PROTOCOL_IBUS] = {
+        "iBus", { IBUS_HEADERBYTE_A, IBUS_HEADERBYTE_B }, 2, IBUS_PACKETSIZE, NULL, parseIBUS
+    },
+    [PROTOCOL_SBUS] = {
+        "SBUS", { SBUS_HEADERBYTE }, 1, SBUS_PACKETSIZE, NULL, parseSBUS
+    },
+    [PROTOCOL_CRSF] = {
+        "CRSF", { CRSF_SYNCBYTE }, 1, 2, frameSizeCRSF, parseCRSF
+    },
+};
+
+/*
+ * Encoding, the inverse of the parse functions above
+ */
+
+static void putBE16(unsigned char *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void putLE16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+/*
+ * Rounding up makes 880 + ((raw * 5) >> 3) return exactly the
+ * original value for everything from 880 up to 2159.
+ */
+static uint16_t unscale11(uint16_t value) {
+    int raw = (value > 880) ? ((((value - 880) * 8) + 4) / 5) : 0;
+    return (raw > 0x7FF) ? 0x7FF : raw;
+}
+
+static void pack11(const uint16_t *channels, unsigned char *data) {
+    uint32_t bits = 0;
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+        bits |= (uint32_t)unscale11(channels[i]) << count;
+        count += 11;
+        while (count >= 8) {
+            *(data++) = bits & 0xFF;
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+}
+
+static int encodeCT6B(const struct decoder_frame_t *f, unsigned char *p) {
+    unsigned char *payload = p + 2;
+    p[0] = CT6B_HEADERBYTE_A;
+    p[1] = CT6B_HEADERBYTE_B;
+
+    for (int i = 0; i < CT6B_CHANNELS; i++) {
+        putBE16(payload + (2 * i), f->channels[i]);
+    }
+    uint16_t test = f->channels[CT6B_TESTCHANNEL];
+    if (f->flags & DECODER_FLAG_TESTCHANNEL) {
+        test ^= 1;
+    }
+    putBE16(payload + (2 * CT6B_CHANNELS), test);
+
+    uint16_t checksum = 0;
+    for (int i = 0; i < CT6B_PAYLOADBYTES; i++) {
+        checksum += payload[i];
+    }
+    putBE16(payload + CT6B_PAYLOADBYTES, checksum);
+
+    return CT6B_PACKETSIZE;
+}
+
+static int encodeIBUS(const struct decoder_frame_t *f, unsigned char *p) {
+    p[0] = IBUS_HEADERBYTE_A;
+    p[1] = IBUS_HEADERBYTE_B;
+    for (int i = 0; i < IBUS_CHANNELS; i++) {
+        putLE16(p + 2 + (2 * i), f->channels[i]);
+    }
+
+    uint16_t checksum = 0xFFFF;
+    for (int i = 0; i < (IBUS_PACKETSIZE - 2); i++) {
+        checksum -= p[i];
+    }
+    putLE16(p + IBUS_PACKETSIZE - 2, checksum);
+
+    return IBUS_PACKETSIZE;
+}
+
+static int encodeSBUS(const struct decoder_frame_t *f, unsigned char *p) {
+    p[0] = SBUS_HEADERBYTE;
+    pack11(f->channels, p + 1);
+
+    unsigned char flags = 0;
+    if (f->flags & DECODER_FLAG_CH17) {
+        flags |= SBUS_FLAG_CH17;
+    }
+    if (f->flags & DECODER_FLAG_CH18) {
+        flags |= SBUS_FLAG_CH18;
+    }
+    if (f->flags & DECODER_FLAG_FRAMELOST) {
+        flags |= SBUS_FLAG_FRAMELOST;
+    }
+    if (f->flags & DECODER_FLAG_FAILSAFE) {
+        flags |= SBUS_FLAG_FAILSAFE;
+    }
+    p[1 + SBUS_DATABYTES] = flags;
+    p[SBUS_PACKETSIZE - 1] = 0x00;
+
+    return SBUS_PACKETSIZE;
+}
+
+static int encodeCRSF(const struct decoder_frame_t *f, unsigned char *p) {
+    p[0] = CRSF_SYNCBYTE;
+    p[1] = CRSF_CHANNELBYTES + 2;
+    p[2] = CRSF_TYPE_CHANNELS;
+    pack11(f->channels, p + 3);
+    p[3 + CRSF_CHANNELBYTES] = decoderCrc8(p + 2, CRSF_CHANNELBYTES + 1);
+
+    return CRSF_CHANNELBYTES + 4;
+}
+
+void decoderInit(struct decoder_t *d, enum decoder_protocol_t protocol) {
+    memset(d, 0, sizeof(struct decoder_t));
+    d->protocol = protocol;
+    crcInit();
+}
+
+const char *decoderName(enum decoder_protocol_t protocol) {
+    if ((protocol < 0) || (protocol >= PROTOCOL_COUNT)) {
+        return "unknown";
+    }
+    return protocols[protocol].name;
+}
+
+/*
+ * Decode all complete frames in buf. Returns the number of bytes
+ * that have been dealt with. Everything after that is the start
+ * of a frame that has not been received completely.
+ */
+static int decoderScan(struct decoder_t *d, const unsigned char *buf, int length,
+        struct decoder_frame_t *frames, int maxFrames, int *count) {
+    const struct protocol_t *p = &protocols[d->protocol];
+    int pos = 0;
+
+    while (pos < length) {
+        const unsigned char *start = memchr(buf + pos, p->header[0], length - pos);
+        if (start == NULL) {
+            d->skipped += length - pos;
+            return length;
+        }
+
+        d->skipped += (start - buf) - pos;
+        pos = start - buf;
+
+        if ((length - pos) < p->headerLength) {
+            // Could be the start of a header
+            return pos;
+        }
+
+        if (memcmp(buf + pos, p->header, p->headerLength) != 0) {
+            d->skipped++;
+            pos++;
+            continue;
+        }
+
+        if ((length - pos) < p->frameLength) {
+            return pos;
+        }
+
+        int size = p->frameLength;
+        if (p->frameSize != NULL) {
+            size = p->frameSize(buf + pos);
+            if (size < 0) {
+                d->skipped++;
+                pos++;
+                continue;
+            }
+
+            if ((length - pos) < size) {
+                return pos;
+            }
+        }
+
+        struct decoder_frame_t frame;
+        enum parse_result_t result = p->parse(d, buf + pos, &frame);
+        if (result != PARSE_INVALID) {
+            d->validBytes += size;
+            if ((d->consumed + pos) < d->resyncEnd) {
+                d->resyncs++;
+            }
+        }
+
+        if (result == PARSE_FRAME) {
+            d->frames++;
+            if (maxFrames > 0) {
+                if (*count < maxFrames) {
+                    frames[(*count)++] = frame;
+                } else {
+                    frames[maxFrames - 1] = frame;
+                    d->dropped++;
+                }
+            } else {
+                d->dropped++;
+            }
+        } else if (result == PARSE_OTHER) {
+            d->otherFrames++;
+        } else {
+            // The header may have been a coincidence, or a real header may be
+            // hidden in the corrupted span. Search again right after this one.
+            d->checksumErrors++;
+            d->resyncEnd = d->consumed + pos + size;
+            d->skipped++;
+            pos++;
+            continue;
+        }
+
+        pos += size;
+    }
+
+    return pos;
+}
+
+int decoderFeed(struct decoder_t *d, const unsigned char *data, int length,
+        struct decoder_frame_t *frames, int maxFrames) {
+    int count = 0;
+
+    // Complete a frame left over from the last call first
+    while ((d->length > 0) && (length > 0)) {
+        int copy = sizeof(d->buffer) - d->length;
+        if (copy > length) {
+            copy = length;
+        }
+
+        memcpy(d->buffer + d->length, data, copy);
+        d->length += copy;
+        data += copy;
+        length -= copy;
+
+        int used = decoderScan(d, d->buffer, d->length, frames, maxFrames, &count);
+        d->consumed += used;
+        d->length -= used;
+        memmove(d->buffer, d->buffer + used, d->length);
+    }
+
+    // Then decode the rest in place, without copying
+    if (length > 0) {
+        int used = decoderScan(d, data, length, frames, maxFrames, &count);
+        d->consumed += used;
+        memcpy(d->buffer, data + used, length - used);
+        d->length = length - used;
+    }
+
+    return count;
+}
+
+void detectorInit(struct detector_t *det) {
+    for (int i = 0; i < PROTOCOL_COUNT; i++) {
+        decoderInit(&det->candidates[i], i);
+    }
+    det->bytes = 0;
+    det->protocol = -1;
+}
+
+int detectorFeed(struct detector_t *det, const unsigned char *data, int length,
+        struct decoder_frame_t *frames, int maxFrames) {
+    if (det->protocol >= 0) {
+        return decoderFeed(&det->candidates[det->protocol], data, length, frames, maxFrames);
+    }
+
+    if (det->bytes >= DETECT_WINDOW) {
+        detectorInit(det);
+    }
+    det->bytes += length;
+
+    // The frames array is overwritten by every candidate until one wins
+    for (int i = 0; i < PROTOCOL_COUNT; i++) {
+        struct decoder_t *d = &det->candidates[i];
+        int count = decoderFeed(d, data, length, frames, maxFrames);
+
+        if (((d->frames + d->otherFrames) >= DETECT_FRAMES)
+                && ((d->validBytes * 2) >= det->bytes)) {
+            det->protocol = i;
+            return count;
+        }
+    }
+
+    return 0;
+}
+
+int decoderEncode(enum decoder_protocol_t protocol, const struct decoder_frame_t *frame,
+        unsigned char *data) {
+    switch (protocol) {
+    case PROTOCOL_CT6B:
+        return encodeCT6B(frame, data);
+    case PROTOCOL_IBUS:
+        return encodeIBUS(frame, data);
+    case PROTOCOL_SBUS:
+        return encodeSBUS(frame, data);
+    case PROTOCOL_CRSF:
+        return encodeCRSF(frame, data);
+    default:
+        return 0;
+    }
+}
+
+struct decoder_t *detectorDecoder(struct detector_t *det) {
+    if (det->protocol < 0) {
+        return NULL;
+    }
+    return &det->candidates[det->protocol];
+}
+
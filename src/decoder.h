@@ -0,0 +1,261 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _DECODER_H_
+#define _DECODER_H_
+
+#include <stdint.h>
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Maximum number of channels any protocol can deliver.
+ */
+#define DECODER_MAX_CHANNELS 16
+
+/*!
+ * \brief Size of the largest frame of any supported protocol.
+ *
+ * The decoder keeps at most this many bytes of an incomplete
+ * frame between two calls to decoderFeed().
+ */
+#define DECODER_MAX_FRAME 64
+
+/*!
+ * \brief Valid frames needed before the detector locks on a protocol.
+ */
+#define DETECT_FRAMES 2
+
+/*!
+ * \brief Bytes after which the detector starts counting from scratch.
+ *
+ * Keeps garbage received before the transmitter was switched on
+ * from affecting the detection forever.
+ */
+#define DETECT_WINDOW 512
+
+#define CT6B_CHANNELS 6 //!< Proportional channels in a CT6B frame
+#define IBUS_CHANNELS 14 //!< Channels in an iBus frame
+#define SBUS_CHANNELS 16 //!< Proportional channels in an SBUS frame
+#define CRSF_CHANNELS 16 //!< Channels in a CRSF RC channels frame
+
+/*!
+ * \brief Set in decoder_frame_t.flags if the CT6B test channel
+ * does not match the channel it is supposed to mirror.
+ */
+#define DECODER_FLAG_TESTCHANNEL (1 << 0)
+
+#define DECODER_FLAG_FRAMELOST (1 << 1) //!< SBUS receiver missed a frame
+#define DECODER_FLAG_FAILSAFE (1 << 2) //!< SBUS receiver is in failsafe
+#define DECODER_FLAG_CH17 (1 << 3) //!< SBUS digital channel 17
+#define DECODER_FLAG_CH18 (1 << 4) //!< SBUS digital channel 18
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Supported receiver protocols.
+ */
+enum decoder_protocol_t {
+    PROTOCOL_CT6B = 0, //!< Flysky CT6A / CT6B trainer port, 18 byte frames
+    PROTOCOL_IBUS,     //!< Flysky iBus servo output, 32 byte frames
+    PROTOCOL_SBUS,     //!< Futaba SBUS, 25 byte frames at 100000 8E2
+    PROTOCOL_CRSF,     //!< Crossfire / ExpressLRS, variable length frames at 420000
+
+    PROTOCOL_COUNT
+};
+
+/*!
+ * \brief A single decoded, checksum-valid frame.
+ *
+ * Channel values are reported as they appear on the wire,
+ * usually in the range of 1000 to 2000. Protocols using other
+ * units, like SBUS, are scaled to this range.
+ */
+struct decoder_frame_t {
+    uint16_t channels[DECODER_MAX_CHANNELS];
+    int count; //!< number of valid entries in channels
+    int flags; //!< DECODER_FLAG_* bits
+};
+
+/*!
+ * \brief Link statistics reported by CRSF receivers.
+ */
+struct decoder_link_t {
+    uint8_t uplinkRssi1; //!< dBm * -1
+    uint8_t uplinkRssi2; //!< dBm * -1
+    uint8_t uplinkQuality; //!< packet success rate in %
+    int8_t uplinkSnr; //!< dB
+    uint8_t activeAntenna;
+    uint8_t rfMode; //!< packet rate, depends on the system
+    uint8_t uplinkTxPower; //!< power level index
+    uint8_t downlinkRssi; //!< dBm * -1
+    uint8_t downlinkQuality; //!< packet success rate in %
+    int8_t downlinkSnr; //!< dB
+};
+
+/*!
+ * \brief Incremental decoder state.
+ *
+ * Everything the decoder needs lives in here, so no allocation
+ * ever takes place while decoding.
+ */
+struct decoder_t {
+    enum decoder_protocol_t protocol;
+    unsigned char buffer[2 * DECODER_MAX_FRAME]; //!< bytes of an incomplete frame
+    int length; //!< number of bytes in buffer
+
+    unsigned long frames; //!< valid frames decoded
+    unsigned long checksumErrors; //!< frames with a wrong checksum
+    unsigned long resyncs; //!< valid frames found inside of the bytes of an invalid one
+    unsigned long dropped; //!< valid frames not returned, output array was full
+    unsigned long skipped; //!< bytes discarded while looking for a header
+    unsigned long validBytes; //!< bytes that were part of a valid frame
+    unsigned long consumed; //!< bytes decoded or skipped so far
+    unsigned long resyncEnd; //!< value of consumed at the end of the last invalid frame
+
+    struct decoder_link_t link; //!< last received link statistics
+    unsigned long linkFrames; //!< link statistics frames received
+    unsigned long otherFrames; //!< valid frames of other types, ignored
+};
+
+/*!
+ * \brief Protocol detector state.
+ *
+ * Runs a decoder for every protocol over the same data and locks
+ * on the first one that is able to decode most of it.
+ */
+struct detector_t {
+    struct decoder_t candidates[PROTOCOL_COUNT];
+    unsigned long bytes; //!< bytes fed in the current window
+    int protocol; //!< detected protocol, or -1
+};
+
+/*
+ * Decoding
+ */
+
+/*!
+ * \brief prepare a decoder for a protocol
+ * \param d decoder state to initialize
+ * \param protocol protocol to decode
+ */
+void decoderInit(struct decoder_t *d, enum decoder_protocol_t protocol);
+
+/*!
+ * \brief get a human readable protocol name
+ * \param protocol protocol to name
+ * \returns static string
+ */
+const char *decoderName(enum decoder_protocol_t protocol);
+
+/*!
+ * \brief decode all frames contained in a chunk of received data
+ *
+ * The data may start and end anywhere inside of a frame. Incomplete
+ * frames are kept in the decoder state and completed by the next call.
+ * After a checksum error the search for the next header continues one
+ * byte after the invalid one, so no frame hidden in the corrupted bytes
+ * is lost.
+ * If more than maxFrames frames are found, the last element of frames
+ * always receives the newest one and the others are counted as dropped.
+ *
+ * \param d decoder state
+ * \param data received bytes
+ * \param length number of received bytes
+ * \param frames array receiving the decoded frames
+ * \param maxFrames number of elements in frames
+ * \returns number of frames stored in frames
+ */
+int decoderFeed(struct decoder_t *d, const unsigned char *data, int length,
+        struct decoder_frame_t *frames, int maxFrames);
+
+/*
+ * Protocol detection
+ */
+
+/*!
+ * \brief prepare a detector
+ * \param det detector state to initialize
+ */
+void detectorInit(struct detector_t *det);
+
+/*!
+ * \brief feed received data to all candidate decoders
+ *
+ * A protocol is detected once DETECT_FRAMES of its frames have been
+ * decoded and at least half of the received bytes belonged to valid
+ * frames. From then on, all data is only passed to that decoder.
+ *
+ * \param det detector state
+ * \param data received bytes
+ * \param length number of received bytes
+ * \param frames array receiving the decoded frames
+ * \param maxFrames number of elements in frames
+ * \returns number of frames stored in frames, always 0 before
+ * a protocol has been detected
+ */
+int detectorFeed(struct detector_t *det, const unsigned char *data, int length,
+        struct decoder_frame_t *frames, int maxFrames);
+
+/*!
+ * \brief get the decoder of the detected protocol
+ * \param det detector state
+ * \returns decoder, or NULL if no protocol has been detected yet
+ */
+struct decoder_t *detectorDecoder(struct detector_t *det);
+
+/*
+ * Encoding
+ */
+
+/*!
+ * \brief create a frame, as sent by a receiver
+ *
+ * Used to generate test data. Decoding the result returns the same
+ * channel values and flags, as long as they can be represented by
+ * the protocol. CRSF frames always contain RC channels.
+ *
+ * \param protocol protocol to encode
+ * \param frame channel values, in the units returned by the decoder,
+ * with the number of channels of the protocol
+ * \param data receives the frame, at least DECODER_MAX_FRAME bytes
+ * \returns length of the frame, 0 if protocol is unknown
+ */
+int decoderEncode(enum decoder_protocol_t protocol, const struct decoder_frame_t *frame,
+        unsigned char *data);
+
+/*!
+ * \brief unpack 16 channels of 11 bits each, as used by SBUS
+ *
+ * Works on 64 bit little endian words with constant shifts instead
+ * of shifting single bits, see bench_sbus.c for a comparison.
+ *
+ * \param data 22 bytes of packed channel data
+ * \param channels receives 16 raw values in the range 0 to 2047
+ */
+void decoderUnpack11(const unsigned char *data, uint16_t *channels);
+
+/*!
+ * \brief calculate the CRC8 (polynomial 0xD5) used by CRSF
+ *
+ * Processes eight bytes per step using slice-by-8 tables,
+ * see bench_crsf.c for a comparison.
+ *
+ * \param data bytes to check
+ * \param length number of bytes
+ * \returns CRC8 of data
+ */
+uint8_t decoderCrc8(const unsigned char *data, int length);
+
+#endif
+
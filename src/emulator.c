@@ -0,0 +1,307 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * Virtual receiver. Creates a pseudo terminal and sends frames of any
+ * supported protocol to it, with the timing of a real receiver, so
+ * foohid and the protocol tools can be tested without hardware.
+ * Every frame carries a stamp (see stamp.h) for end-to-end latency
+ * and frame loss measurements with foohid -e.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // posix_openpt(), cfmakeraw()
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+
+#include "serial.h"
+#include "decoder.h"
+#include "stamp.h"
+
+#define SEED 42
+#define IDLEVALUE 1500 // channels not used for the stamp
+#define MOTIONAMPLITUDE 400 // deviation from IDLEVALUE of moving sticks
+#define TWOPI 6.28318530718
+
+// Line settings and frame rate of each protocol
+static const struct {
+    unsigned int baud;
+    const char *format;
+    unsigned int rate; // Hz
+} defaults[PROTOCOL_COUNT] = {
+    [PROTOCOL_CT6B] = { 115200, "8N1", 50 },
+    [PROTOCOL_IBUS] = { 115200, "8N1", 143 }, // 7ms
+    [PROTOCOL_SBUS] = { 100000, "8E2", 71 }, // 14ms, 7ms in high speed mode
+    [PROTOCOL_CRSF] = { 420000, "8N1", 250 },
+};
+
+static int running = 1;
+static uint32_t seed = SEED;
+
+static void signalHandler(int signo) {
+    running = 0;
+}
+
+// Uniformly distributed in [0, 1)
+static double randomUnit(void) {
+    seed = (seed * 1103515245) + 12345;
+    return (seed >> 8) / (double)(1 << 24);
+}
+
+static void sleepUntil(uint64_t time) {
+    uint64_t now = serialTime();
+    if (time <= now) {
+        return;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = (time - now) / 1000000;
+    ts.tv_nsec = ((time - now) % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+}
+
+static int openTerminal(int *slave) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master == -1) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+        perror("Couldn't create pseudo terminal");
+        return -1;
+    }
+
+    // Keep the slave open, so writing works before the reader opens it,
+    // and make it raw, so nothing is echoed back into the master.
+    *slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (*slave == -1) {
+        perror("Couldn't open pseudo terminal");
+        close(master);
+        return -1;
+    }
+
+    struct termios options;
+    tcgetattr(*slave, &options);
+    cfmakeraw(&options);
+    tcsetattr(*slave, TCSANOW, &options);
+
+    // A full buffer means nobody is reading, never block because of that
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    return master;
+}
+
+int main(int argc, char* argv[]) {
+    enum decoder_protocol_t protocol = PROTOCOL_CT6B;
+    struct serial_config_t config;
+    serialDefaultConfig(&config, 0);
+    const char *format = NULL;
+    double rate = 0.0;
+    unsigned int jitter = 0;
+    double noise = 0.0;
+    double dropout = 0.0;
+    unsigned int duration = 0;
+    const char *link = NULL;
+    bool paced = false;
+    double motion = 0.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "6iscb:f:r:j:n:d:D:L:wm:")) != -1) {
+        switch (opt) {
+        case '6':
+            protocol = PROTOCOL_CT6B;
+            break;
+        case 'i':
+            protocol = PROTOCOL_IBUS;
+            break;
+        case 's':
+            protocol = PROTOCOL_SBUS;
+            break;
+        case 'c':
+            protocol = PROTOCOL_CRSF;
+            break;
+        case 'b':
+            config.baud = atoi(optarg);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'j':
+            jitter = atoi(optarg);
+            break;
+        case 'n':
+            noise = atof(optarg) / 100.0;
+            break;
+        case 'd':
+            dropout = atof(optarg) / 100.0;
+            break;
+        case 'D':
+            duration = atoi(optarg);
+            break;
+        case 'L':
+            link = optarg;
+            break;
+        case 'w':
+            paced = true;
+            break;
+        case 'm':
+            motion = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage:\n\t%s [-6 | -i | -s | -c] [options]\n", argv[0]);
+            fprintf(stderr, "\t-6         CT6B protocol (default)\n");
+            fprintf(stderr, "\t-i         iBus protocol\n");
+            fprintf(stderr, "\t-s         SBUS protocol\n");
+            fprintf(stderr, "\t-c         CRSF / ExpressLRS protocol\n");
+            fprintf(stderr, "Options:\n");
+            fprintf(stderr, "\t-b <baud>   emulated baudrate, default depends on protocol\n");
+            fprintf(stderr, "\t-f <format> emulated format, eg. 8N1 or 8E2\n");
+            fprintf(stderr, "\t-r <rate>   frames per second, default depends on protocol\n");
+            fprintf(stderr, "\t-j <us>     maximum random deviation from the frame rate\n");
+            fprintf(stderr, "\t-n <%%>      probability of a byte being corrupted\n");
+            fprintf(stderr, "\t-d <%%>      probability of a frame being dropped\n");
+            fprintf(stderr, "\t-D <s>      stop after this many seconds\n");
+            fprintf(stderr, "\t-L <path>   create a symlink to the pseudo terminal\n");
+            fprintf(stderr, "\t-w         send byte by byte at the emulated baudrate\n");
+            fprintf(stderr, "\t-m <Hz>     move the sticks in sine waves instead of sending stamps\n");
+            return 1;
+        }
+    }
+
+    if (config.baud == 0) {
+        config.baud = defaults[protocol].baud;
+    }
+    if (serialParseFormat(&config, (format != NULL) ? format : defaults[protocol].format) != 0) {
+        fprintf(stderr, "Invalid format\n");
+        return 1;
+    }
+    if (rate <= 0.0) {
+        rate = defaults[protocol].rate;
+    }
+
+    int slave;
+    int master = openTerminal(&slave);
+    if (master == -1) {
+        return 1;
+    }
+
+    if (link != NULL) {
+        unlink(link);
+        if (symlink(ptsname(master), link) != 0) {
+            perror("Couldn't create symlink");
+            return 1;
+        }
+    }
+
+    if (signal(SIGINT, signalHandler) == SIG_ERR) {
+        perror("Couldn't register signal handler");
+        return 1;
+    }
+
+    // Start, data, parity and stop bits of every byte
+    int bits = 1 + config.dataBits + ((config.parity != 'N') ? 1 : 0) + config.stopBits;
+    uint64_t byteTime = (1000000ULL * bits) / config.baud;
+    uint64_t period = 1000000 / rate;
+
+    printf("Emulating %s at %.1fHz, %u baud %d%c%d, on %s\n", decoderName(protocol), rate,
+            config.baud, config.dataBits, config.parity, config.stopBits,
+            (link != NULL) ? link : ptsname(master));
+
+    unsigned long sent = 0, dropped = 0, corrupted = 0, overflows = 0;
+    uint32_t sequence = 0;
+    uint64_t start = serialTime();
+    uint64_t next = start + period;
+
+    while (running && ((duration == 0) || ((serialTime() - start) < (duration * 1000000ULL)))) {
+        // Time the last byte of this frame arrives
+        uint64_t due = next;
+        if (jitter > 0) {
+            due += (uint64_t)(randomUnit() * ((2 * jitter) + 1)) - jitter;
+        }
+        next += period;
+
+        // Lost frames still use up a sequence number
+        sequence++;
+        if ((dropout > 0.0) && (randomUnit() < dropout)) {
+            dropped++;
+            sleepUntil(due);
+            continue;
+        }
+
+        struct decoder_frame_t frame;
+        for (int i = 0; i < DECODER_MAX_CHANNELS; i++) {
+            frame.channels[i] = IDLEVALUE;
+        }
+        frame.count = 0;
+        frame.flags = 0;
+
+        unsigned char buffer[DECODER_MAX_FRAME];
+        int length;
+        if (motion > 0.0) {
+            // Position of the sticks when the last byte is due, each a bit behind the previous
+            for (int i = 0; i < STAMP_CHANNELS; i++) {
+                frame.channels[i] = IDLEVALUE + (int)(MOTIONAMPLITUDE
+                        * sin((TWOPI * motion * due / 1e6) - (i * TWOPI / STAMP_CHANNELS)));
+            }
+            frame.count = STAMP_CHANNELS;
+            if (!paced) {
+                sleepUntil(due);
+            }
+            length = decoderEncode(protocol, &frame, buffer);
+        } else if (paced) {
+            // Stamp with the time the last byte is due
+            stampWrite(&frame, sequence, due);
+            length = decoderEncode(protocol, &frame, buffer);
+        } else {
+            sleepUntil(due);
+            stampWrite(&frame, sequence, serialTime());
+            length = decoderEncode(protocol, &frame, buffer);
+        }
+
+        for (int i = 0; i < length; i++) {
+            if ((noise > 0.0) && (randomUnit() < noise)) {
+                buffer[i] ^= 1 + (int)(randomUnit() * 255);
+                corrupted++;
+            }
+        }
+
+        int chunk = paced ? 1 : length;
+        for (int i = 0; i < length; i += chunk) {
+            if (paced) {
+                sleepUntil(due - ((length - 1 - i) * byteTime));
+            }
+            if (write(master, buffer + i, chunk) != chunk) {
+                overflows++;
+                break;
+            }
+        }
+        sent++;
+    }
+
+    printf("\nSent %lu frames, %lu dropped, %lu bytes corrupted, %lu frames overflowed\n",
+            sent, dropped, corrupted, overflows);
+
+    if (link != NULL) {
+        unlink(link);
+    }
+    close(slave);
+    close(master);
+
+    return 0;
+}
+
@@ -0,0 +1,246 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * The One-Euro filter is described in:
+ * Casiez, Roussel, Vogel: 1 Euro Filter: A Simple Speed-based Low-pass
+ * Filter for Noisy Input in Interactive Systems, CHI 2012
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+// SSE2 is part of every x86-64 CPU and NEON of every 64 bit ARM CPU,
+// so neither needs special compiler flags or a check at runtime
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VECTOR_NAME "SSE2"
+#define VECTOR_WIDTH 4
+typedef __m128 vector_t;
+#define vLoad(p) _mm_load_ps(p)
+#define vStore(p, v) _mm_store_ps((p), (v))
+#define vSet(x) _mm_set1_ps(x)
+#define vAdd(a, b) _mm_add_ps((a), (b))
+#define vSub(a, b) _mm_sub_ps((a), (b))
+#define vMul(a, b) _mm_mul_ps((a), (b))
+#define vDiv(a, b) _mm_div_ps((a), (b))
+#define vMin(a, b) _mm_min_ps((a), (b))
+#define vMax(a, b) _mm_max_ps((a), (b))
+#define vAbs(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), (a))
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VECTOR_NAME "NEON"
+#define VECTOR_WIDTH 4
+typedef float32x4_t vector_t;
+#define vLoad(p) vld1q_f32(p)
+#define vStore(p, v) vst1q_f32((p), (v))
+#define vSet(x) vdupq_n_f32(x)
+#define vAdd(a, b) vaddq_f32((a), (b))
+#define vSub(a, b) vsubq_f32((a), (b))
+#define vMul(a, b) vmulq_f32((a), (b))
+#define vDiv(a, b) vdivq_f32((a), (b))
+#define vMin(a, b) vminq_f32((a), (b))
+#define vMax(a, b) vmaxq_f32((a), (b))
+#define vAbs(a) vabsq_f32(a)
+#endif
+
+#define TWOPI 6.28318530718f
+
+const char *filterInstructions(void) {
+#ifdef VECTOR_NAME
+    return VECTOR_NAME;
+#else
+    return "scalar";
+#endif
+}
+
+int filterParse(struct filter_t *f, const char *filters) {
+    f->median = 0;
+    f->euro = 0;
+    f->minCutoff = FILTER_MINCUTOFF;
+    f->beta = FILTER_BETA;
+
+    const char *p = filters;
+    for (;;) {
+        if (strncmp(p, "median", 6) == 0) {
+            f->median = 1;
+            p += 6;
+        } else if (strncmp(p, "euro", 4) == 0) {
+            f->euro = 1;
+            p += 4;
+
+            char *end;
+            if (*p == '=') {
+                f->minCutoff = strtof(p + 1, &end);
+                if ((end == (p + 1)) || (f->minCutoff <= 0.0f)) {
+                    return -1;
+                }
+                p = end;
+
+                if (*p == ':') {
+                    f->beta = strtof(p + 1, &end);
+                    if ((end == (p + 1)) || (f->beta < 0.0f)) {
+                        return -1;
+                    }
+                    p = end;
+                }
+            }
+        } else {
+            return -1;
+        }
+
+        if (*p != ',') {
+            break;
+        }
+        p++;
+    }
+
+    filterReset(f);
+    return (*p == '\0') ? 0 : -1;
+}
+
+void filterReset(struct filter_t *f) {
+    f->frames = 0;
+    f->last = 0;
+    f->period = FILTER_PERIOD / 1e9f;
+}
+
+// Frames from a single read arrive at the same time, they keep the last interval
+static float filterInterval(struct filter_t *f, uint64_t time) {
+    if ((f->frames > 0) && (time > f->last)) {
+        f->period = (time - f->last) / 1e9f;
+    }
+    f->last = time;
+    f->frames++;
+    return f->period;
+}
+
+// Start all channels at the values of the first frame, returns 1 if it was.
+// Called after filterInterval() already counted the frame.
+static int filterStart(struct filter_t *f, const float *raw) {
+    if (f->frames > 1) {
+        return 0;
+    }
+    for (int i = 0; i < FILTER_CHANNELS; i++) {
+        f->previous[0][i] = raw[i];
+        f->previous[1][i] = raw[i];
+        f->value[i] = raw[i];
+        f->slope[i] = 0.0f;
+    }
+    return 1;
+}
+
+static void filterStore(const float *filtered, struct decoder_frame_t *frame) {
+    for (int i = 0; i < frame->count; i++) {
+        frame->channels[i] = (uint16_t)(filtered[i] + 0.5f);
+    }
+}
+
+void filterApplyScalar(struct filter_t *f, struct decoder_frame_t *frame, uint64_t time) {
+    float dt = filterInterval(f, time);
+    float raw[FILTER_CHANNELS];
+    for (int i = 0; i < FILTER_CHANNELS; i++) {
+        raw[i] = frame->channels[i];
+    }
+    if (filterStart(f, raw)) {
+        return;
+    }
+
+    float rate = 1.0f / dt;
+    float r = TWOPI * FILTER_SLOPECUTOFF * dt;
+    float alphaSlope = r / (r + 1.0f);
+    float cutoffScale = TWOPI * dt;
+
+    float filtered[FILTER_CHANNELS];
+    for (int i = 0; i < FILTER_CHANNELS; i++) {
+        float x = raw[i];
+
+        if (f->median) {
+            float a = f->previous[0][i];
+            float b = f->previous[1][i];
+            f->previous[0][i] = b;
+            f->previous[1][i] = x;
+            float low = (a < b) ? a : b;
+            float high = (a < b) ? b : a;
+            float middle = (high < x) ? high : x;
+            x = (low < middle) ? middle : low;
+        }
+
+        if (f->euro) {
+            float value = f->value[i];
+            float slope = f->slope[i];
+            slope = slope + (alphaSlope * (((x - value) * rate) - slope));
+            float magnitude = (slope < 0.0f) ? -slope : slope;
+            float cutoff = (f->minCutoff + (f->beta * magnitude)) * cutoffScale;
+            float alpha = cutoff / (cutoff + 1.0f);
+            value = value + (alpha * (x - value));
+            f->value[i] = value;
+            f->slope[i] = slope;
+            x = value;
+        }
+
+        filtered[i] = x;
+    }
+
+    filterStore(filtered, frame);
+}
+
+void filterApply(struct filter_t *f, struct decoder_frame_t *frame, uint64_t time) {
+#ifdef VECTOR_WIDTH
+    float dt = filterInterval(f, time);
+    _Alignas(16) float raw[FILTER_CHANNELS];
+    for (int i = 0; i < FILTER_CHANNELS; i++) {
+        raw[i] = frame->channels[i];
+    }
+    if (filterStart(f, raw)) {
+        return;
+    }
+
+    // Same operations in the same order as filterApplyScalar(), so the results are identical
+    float r = TWOPI * FILTER_SLOPECUTOFF * dt;
+    vector_t rate = vSet(1.0f / dt);
+    vector_t alphaSlope = vSet(r / (r + 1.0f));
+    vector_t cutoffScale = vSet(TWOPI * dt);
+    vector_t minCutoff = vSet(f->minCutoff);
+    vector_t beta = vSet(f->beta);
+    vector_t one = vSet(1.0f);
+
+    _Alignas(16) float filtered[FILTER_CHANNELS];
+    for (int i = 0; i < FILTER_CHANNELS; i += VECTOR_WIDTH) {
+        vector_t x = vLoad(&raw[i]);
+
+        if (f->median) {
+            vector_t a = vLoad(&f->previous[0][i]);
+            vector_t b = vLoad(&f->previous[1][i]);
+            vStore(&f->previous[0][i], b);
+            vStore(&f->previous[1][i], x);
+            x = vMax(vMin(a, b), vMin(vMax(a, b), x));
+        }
+
+        if (f->euro) {
+            vector_t value = vLoad(&f->value[i]);
+            vector_t slope = vLoad(&f->slope[i]);
+            slope = vAdd(slope, vMul(alphaSlope, vSub(vMul(vSub(x, value), rate), slope)));
+            vector_t cutoff = vMul(vAdd(minCutoff, vMul(beta, vAbs(slope))), cutoffScale);
+            vector_t alpha = vDiv(cutoff, vAdd(cutoff, one));
+            value = vAdd(value, vMul(alpha, vSub(x, value)));
+            vStore(&f->value[i], value);
+            vStore(&f->slope[i], slope);
+            x = value;
+        }
+
+        vStore(&filtered[i], x);
+    }
+
+    filterStore(filtered, frame);
+#else
+    filterApplyScalar(f, frame, time);
+#endif
+}
+
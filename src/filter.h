@@ -0,0 +1,112 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <stdint.h>
+
+#include "decoder.h"
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Channels filtered at once, a multiple of the vector width.
+ */
+#define FILTER_CHANNELS DECODER_MAX_CHANNELS
+
+#define FILTER_MINCUTOFF 1.0f //!< Default One-Euro cutoff at rest, in Hz
+#define FILTER_BETA 0.007f //!< Default One-Euro cutoff increase per channel value/s
+#define FILTER_SLOPECUTOFF 1.0f //!< Cutoff of the speed estimate, in Hz
+
+/*!
+ * \brief Frame interval used until two frames arrived at different times, in ns.
+ */
+#define FILTER_PERIOD 7000000
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief State of all channels.
+ *
+ * Channel values are kept as floats, so one vector instruction
+ * processes 4 channels with SSE2 or NEON.
+ */
+struct filter_t {
+    int median; //!< reject single frame spikes with a median of 3 frames
+    int euro; //!< smooth with a One-Euro filter
+    float minCutoff; //!< One-Euro cutoff at rest, in Hz
+    float beta; //!< One-Euro cutoff increase per channel value/s
+
+    _Alignas(16) float previous[2][FILTER_CHANNELS]; //!< last two unfiltered frames
+    _Alignas(16) float value[FILTER_CHANNELS]; //!< last smoothed values
+    _Alignas(16) float slope[FILTER_CHANNELS]; //!< smoothed speed, in channel values/s
+
+    unsigned long frames; //!< frames filtered since filterReset()
+    uint64_t last; //!< arrival of the last frame
+    float period; //!< last interval between two frames, in s
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief name of the instruction set used by filterApply()
+ * \returns "SSE2", "NEON" or "scalar"
+ */
+const char *filterInstructions(void);
+
+/*!
+ * \brief turn filters on from a list of names
+ *
+ * The list contains median, euro or both, separated by a comma.
+ * euro can be followed by =<min cutoff in Hz>:<beta>, or just
+ * =<min cutoff in Hz>.
+ *
+ * \param f filter to set up
+ * \param filters list of filters
+ * \returns 0 on success, -1 if the list is invalid
+ */
+int filterParse(struct filter_t *f, const char *filters);
+
+/*!
+ * \brief forget all previous frames, eg. after a new protocol was detected
+ * \param f filter to reset
+ */
+void filterReset(struct filter_t *f);
+
+/*!
+ * \brief filter a frame in place
+ *
+ * The median of the last 3 frames delays steps by one frame, but a
+ * wrong value in a single frame never reaches the output. The
+ * One-Euro filter smooths strongly while a channel barely moves and
+ * follows closely while it moves fast.
+ *
+ * \param f filter state
+ * \param frame decoded channel values, replaced with the filtered values
+ * \param time arrival of the frame, in ns
+ */
+void filterApply(struct filter_t *f, struct decoder_frame_t *frame, uint64_t time);
+
+/*!
+ * \brief filterApply() without vector instructions, for comparison
+ * \param f filter state
+ * \param frame decoded channel values, replaced with the filtered values
+ * \param time arrival of the frame, in ns
+ */
+void filterApplyScalar(struct filter_t *f, struct decoder_frame_t *frame, uint64_t time);
+
+#endif
+
@@ -8,6 +8,7 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -15,373 +16,535 @@
 #include <unistd.h>
 #include <getopt.h>
 
-#include <IOKit/IOKitLib.h>
-
 #include "serial.h"
+#include "decoder.h"
+#include "latency.h"
+#include "reader.h"
+#include "stamp.h"
+#include "sink.h"
+#include "output.h"
+#include "transfer.h"
+#include "filter.h"
+#include "upsample.h"
+#include "realtime.h"
 
 #define BAUDRATE 115200
-#define PACKETSIZE 18
-#define HEADERBYTES 2
-#define HEADERBYTE_A 85
-#define HEADERBYTE_B 252
-#define CHECKSUMBYTES 2
-#define PAYLOADBYTES (PACKETSIZE - HEADERBYTES - CHECKSUMBYTES)
-#define CHANNELS 6
-#define TESTCHANNEL 2
-#define CHANNELMAXIMUM 1022
-
-
-#define IBUS_HEADERBYTES 2
-#define IBUS_HEADERBYTE_A 0x20
-#define IBUS_HEADERBYTE_B 0x40
-#define IBUS_CHANNELS 14
-
-
-#define FOOHID_NAME "it_unbit_foohid"
-#define FOOHID_CREATE 0
-#define FOOHID_DESTROY 1
-#define FOOHID_SEND 2
-#define FOOHID_LIST 3
-#define VIRTUAL_DEVICE_NAME "Virtual Serial Transmitter"
-#define VIRTUAL_DEVICE_SERIAL "SN 123456"
-
-struct gamepad_report_t {
-    int16_t leftX;
-    int16_t leftY;
-    int16_t rightX;
-    int16_t rightY;
-    int16_t aux1;
-    int16_t aux2;
-};
+#define FRAMES 32
+#define READTIMEOUT 100000 // us, only bounds the reaction time to SIGINT
+#define LINKINTERVAL 10 // CRSF link statistics frames between two debug outputs
+#define DETECTTIMEOUT 250000 // us until the next line settings are tried
 
 static int running = 1;
-static io_iterator_t iterator;
-static io_service_t service;
-static io_connect_t connect;
-#define input_count 8
-static uint64_t input[input_count];
-static struct gamepad_report_t gamepad;
+static struct sink_t *sink = NULL;
+static struct sink_report_t report;
+static struct transfer_t transfer;
+static const char *profile = NULL;
 
 bool debug = false;
-bool raw_ibus = false;
-
-/*
- * This is my USB HID Descriptor for this emulated Gamepad.
- * For more informations refer to:
- * http://eleccelerator.com/tutorial-about-usb-hid-report-descriptors/
- * http://www.usb.org/developers/hidpage#HID%20Descriptor%20Tool
- */
-static char report_descriptor[36] = {
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x09, 0x05,                    // USAGE (Game Pad)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0xa1, 0x00,                    //   COLLECTION (Physical)
-    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30,                    //     USAGE (X)
-    0x09, 0x31,                    //     USAGE (Y)
-    0x09, 0x32,                    //     USAGE (Z)
-    0x09, 0x33,                    //     USAGE (Rx)
-    0x09, 0x34,                    //     USAGE (Ry)
-    0x09, 0x35,                    //     USAGE (Rz)
-    0x16, 0x01, 0xfe,              //     LOGICAL_MINIMUM (-511)
-    0x26, 0xff, 0x01,              //     LOGICAL_MAXIMUM (511)
-    0x75, 0x10,                    //     REPORT_SIZE (16)
-    0x95, 0x06,                    //     REPORT_COUNT (6)
-    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
-    0xc0,                          //     END_COLLECTION
-    0xc0                           // END_COLLECTION
+static bool detect = true;
+static enum decoder_protocol_t protocol = PROTOCOL_CT6B;
+static bool measure = false;
+static struct latency_t latency;
+static bool endToEnd = false;
+static struct stamp_stats_t stamps;
+static volatile sig_atomic_t printStatistics = 0;
+static bool threaded = false;
+static struct output_t output;
+static bool filtering = false;
+static struct filter_t filter;
+static struct latency_histogram_t arrivalJitter;
+static uint64_t lastArrival = 0, arrivalInterval = 0;
+static bool realtime = false;
+static struct realtime_t rt;
+
+// Line settings of each protocol, unless overridden with -b or -f
+static const struct {
+    unsigned int baud;
+    const char *format;
+} lineDefaults[PROTOCOL_COUNT] = {
+    [PROTOCOL_CT6B] = { BAUDRATE, "8N1" },
+    [PROTOCOL_IBUS] = { BAUDRATE, "8N1" },
+    [PROTOCOL_SBUS] = { 100000, "8E2" },
+    [PROTOCOL_CRSF] = { 420000, "8N1" },
 };
 
-static int foohidInit() {
-    printf("Searching for foohid Kernel extension...\n");
-
-    // get a reference to the IOService
-    kern_return_t ret = IOServiceGetMatchingServices(kIOMasterPortDefault,
-                            IOServiceMatching(FOOHID_NAME), &iterator);
-    if (ret != KERN_SUCCESS) {
-        printf("Unable to access foohid IOService\n");
-        exit(1);
+// Calibration of the protocol, changed by the profile, computed into tables
+static int foohidTransfer(void) {
+    transferInit(&transfer, protocol);
+    if ((profile != NULL) && (transferLoad(&transfer, profile) != 0)) {
+        return -1;
     }
+    transferBuild(&transfer);
+    return 0;
+}
 
-    int found = 0;
-    while ((service = IOIteratorNext(iterator)) != IO_OBJECT_NULL) {
-        ret = IOServiceOpen(service, mach_task_self(), 0, &connect);
-        if (ret == KERN_SUCCESS) {
-            found = 1;
-            break;
-        }
-    }
-    IOObjectRelease(iterator);
-    if (!found) {
-        printf("Unable to open foohid IOService\n");
-        exit(1);
-    }
-
-    printf("Creating virtual HID device...\n");
-
-    input[0] = (uint64_t)strdup(VIRTUAL_DEVICE_NAME);
-    input[1] = strlen((char*)input[0]);
-
-    input[2] = (uint64_t)report_descriptor;
-    input[3] = sizeof(report_descriptor);
-
-    input[4] = (uint64_t)strdup(VIRTUAL_DEVICE_SERIAL);
-    input[5] = strlen((char*)input[4]);
-
-    input[6] = (uint64_t)2; // vendor ID
-    input[7] = (uint64_t)3; // device ID
-
-    ret = IOConnectCallScalarMethod(connect, FOOHID_CREATE, input, input_count, NULL, 0);
-    if (ret != KERN_SUCCESS) {
-        printf("Unable to create virtual HID device\n");
-        exit(1);
+// Map and send one frame, from the main loop or the output thread
+static void foohidOutput(const struct mailbox_entry_t *entry) {
+    uint64_t start = measure ? latencyNow() : 0;
+    transferApply(&transfer, &entry->frame, &report);
+    uint64_t mapped = measure ? latencyNow() : 0;
+    sinkSend(sink, &report);
+
+    if (measure) {
+        uint64_t sent = latencyNow();
+        latencyRecord(&latency, LATENCY_MAPPING, start, mapped);
+        latencyRecord(&latency, LATENCY_SEND, mapped, sent);
+        latencyRecord(&latency, LATENCY_TOTAL, entry->time, sent);
     }
-
-    return 0;
 }
 
-static void foohidClose() {
-    printf("Destroying virtual HID device\n");
+static void signalHandler(int signo) {
+    running = 0;
+    printf("\n");
+}
 
-    kern_return_t ret = IOConnectCallScalarMethod(connect, FOOHID_DESTROY, input, 2, NULL, 0);
-    if (ret != KERN_SUCCESS) {
-        printf("Unable to destroy virtual HID device\n");
-    }
+static void statisticsHandler(int signo) {
+    printStatistics = 1;
 }
 
-static void foohidSend(uint16_t *data, int channels, bool raw_ibus) {
-    if (raw_ibus) {
-        //values go from 1000 - 2000
-        gamepad.leftX = data[3] - 1500;
-        gamepad.leftY = data[2] - 1500;
-        gamepad.rightX = data[0] - 1500;
-        gamepad.rightY = data[1] - 1500;
-        gamepad.aux1 = data[4] - 1500;
-        gamepad.aux2 = data[5] - 1500;
-    } else {
-        for (int i = 0; i < channels; i++) {
-            if (data[i] > CHANNELMAXIMUM) {
-                data[i] = CHANNELMAXIMUM;
-            }
+// Jitter of the frame arrivals, computed like the send jitter of the sink.
+// Frames from a single read arrive at the same time, so each read is one
+// arrival and its interval is shared by the count frames it brought.
+static void foohidArrival(uint64_t time, unsigned int count) {
+    if (lastArrival != 0) {
+        uint64_t interval = (time - lastArrival) / count;
+        if (arrivalInterval != 0) {
+            latencyAdd(&arrivalJitter, (interval > arrivalInterval) ? (interval - arrivalInterval)
+                    : (arrivalInterval - interval));
         }
-        gamepad.leftX = data[3] - 511;
-        gamepad.leftY = data[2] - 511;
-        gamepad.rightX = data[0] - 511;
-        gamepad.rightY = data[1] - 511;
-        gamepad.aux1 = data[4] - 511;
-        gamepad.aux2 = data[5] - 511;
+        arrivalInterval = interval;
     }
+    lastArrival = time;
+}
 
-    if (!debug) {
-        input[2] = (uint64_t)&gamepad;
-        input[3] = sizeof(struct gamepad_report_t);
-        kern_return_t ret = IOConnectCallScalarMethod(connect, FOOHID_SEND, input, 4, NULL, 0);
-        if (ret != KERN_SUCCESS) {
-            fprintf(stderr, "Unable to send packet to virtual HID device\n");
+static void statisticsPrint(const struct reader_t *reader, const struct decoder_t *decoder) {
+    if (measure) {
+        latencyPrint(&latency, stdout);
+        unsigned long frames = (decoder != NULL) ? decoder->frames : 0;
+        fprintf(stdout, "Read %s: %lu frames, %lu system calls, %.2f per frame\n", readerBackend(reader),
+                frames, readerSyscalls(reader), (frames > 0) ? ((double)readerSyscalls(reader) / frames) : 0.0);
+        sinkPrint(sink, stdout);
+        fprintf(stdout, "Arrival jitter: p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+                latencyPercentile(&arrivalJitter, 50.0) / 1000.0,
+                latencyPercentile(&arrivalJitter, 99.0) / 1000.0,
+                latencyPercentile(&arrivalJitter, 99.9) / 1000.0,
+                arrivalJitter.max / 1000.0);
+        if (threaded) {
+            outputPrint(&output, stdout);
         }
-    } else {
-        printf("Left X: %4d ", gamepad.leftX);
-        printf("Left Y: %4d ", gamepad.leftY);
-        printf("Right X: %4d ", gamepad.rightX);
-        printf("Right Y: %4d ", gamepad.rightY);
-        printf("Aux 1: %4d ", gamepad.aux1);
-        printf("Aux 2: %4d\n", gamepad.aux2);
     }
-}
-
-static void signalHandler(int signo) {
-    running = 0;
-    printf("\n");
+    if (endToEnd) {
+        stampPrint(&stamps, stdout);
+    }
+    if (realtime) {
+        realtimePrint(&rt, stdout);
+    }
 }
 
 int main(int argc, char* argv[]) {
     char *serial_port = NULL;
+    struct serial_config_t config;
+    serialDefaultConfig(&config, 0);
+    bool formatSet = false;
+    const char *sinkName = NULL;
+    const char *deadband = NULL;
+    unsigned int keepAlive = SINK_KEEPALIVE;
+    unsigned int outputRate = 0;
+    unsigned int lockDelay = 0;
+    struct upsample_t upsample;
+    bool upsampling = false;
+    struct reader_t reader;
+    readerInit(&reader);
 
     int opt;
 
-    while ((opt = getopt(argc, argv, "p:di")) != EOF) {
+    while ((opt = getopt(argc, argv, "p:do:z:k:O:U:P:F:R:6iscLe" READER_OPTIONS SERIAL_OPTIONS)) != EOF) {
         switch (opt) {
         case 'p':
             serial_port = optarg;
             break;
         case 'd':
             debug = true;
+            sinkName = "debug";
+            break;
+        case 'o':
+            sinkName = optarg;
+            break;
+        case 'z':
+            deadband = optarg;
+            break;
+        case 'k':
+            keepAlive = atoi(optarg);
+            break;
+        case 'O':
+            if (strncmp(optarg, "lock", 4) == 0) {
+                lockDelay = (optarg[4] == '=') ? atoi(optarg + 5) : OUTPUT_LOCKDELAY;
+                if (((optarg[4] != '=') && (optarg[4] != '\0')) || (lockDelay == 0)) {
+                    fprintf(stderr, "Invalid output lock %s\n", optarg);
+                    exit(1);
+                }
+                outputRate = 0;
+            } else {
+                outputRate = atoi(optarg);
+                lockDelay = 0;
+            }
+            threaded = true;
+            break;
+        case 'U':
+            if (upsampleParse(&upsample, optarg) != 0) {
+                fprintf(stderr, "Invalid upsampling %s\n", optarg);
+                exit(1);
+            }
+            upsampling = true;
+            break;
+        case 'P':
+            profile = optarg;
+            break;
+        case 'F':
+            if (filterParse(&filter, optarg) != 0) {
+                fprintf(stderr, "Invalid filter %s\n", optarg);
+                exit(1);
+            }
+            filtering = true;
+            break;
+        case 'R':
+            if (realtimeParse(&rt, optarg) != 0) {
+                fprintf(stderr, "Invalid real-time settings %s\n", optarg);
+                exit(1);
+            }
+            realtime = true;
+            break;
+        case '6':
+            protocol = PROTOCOL_CT6B;
+            detect = false;
             break;
         case 'i':
-            raw_ibus = true;
+            protocol = PROTOCOL_IBUS;
+            detect = false;
+            break;
+        case 's':
+            protocol = PROTOCOL_SBUS;
+            detect = false;
+            break;
+        case 'c':
+            protocol = PROTOCOL_CRSF;
+            detect = false;
+            break;
+        case 'L':
+            measure = true;
+            break;
+        case 'e':
+            endToEnd = true;
+            break;
+        default:
+            if (readerParseOption(&reader, opt, optarg) == 1) {
+                break;
+            }
+            if (serialParseOption(&config, opt, optarg) != 1) {
+                fprintf(stderr, "Usage:\n\t%s -p <port> [-d | -o <sink>] [-P <profile>] [-F <filters>] [-z <deadband>] [-O <Hz> [-U <mode>] | -O lock[=<us>]] [-R <cpus>] [-L] [-e] [-6 | -i | -s | -c] [options]\n", argv[0]);
+                fprintf(stderr, "\t%s -r <file> [-d | -o <sink>] [-P <profile>] [-F <filters>] [-z <deadband>] [-O <Hz> [-U <mode>] | -O lock[=<us>]] [-R <cpus>] [-L] [-e] [-6 | -i | -s | -c] [options]\n", argv[0]);
+                fprintf(stderr, "\t-d         debug mode, print values and link statistics instead of sending\n");
+                fprintf(stderr, "\t-o <sink>  output to one of: %s\n", sinkNames());
+                fprintf(stderr, "\t-P <file>  channel mapping, calibration and curves of axes and buttons\n");
+                fprintf(stderr, "\t-F <list>  filter the channels with median, euro[=<Hz>[:<beta>]] or both,\n");
+                fprintf(stderr, "\t           separated by commas, using %s\n", filterInstructions());
+                fprintf(stderr, "\t-z <band>  skip reports without changes larger than band,\n");
+                fprintf(stderr, "\t           up to %d separated by commas, 0 for any change\n", SINK_AXES);
+                fprintf(stderr, "\t-k <ms>    send unchanged reports after this time, default %d\n", SINK_KEEPALIVE);
+                fprintf(stderr, "\t-O <Hz>    send from a separate thread at this rate, 0 for every new frame\n");
+                fprintf(stderr, "\t-U <mode>  create reports between frames: interpolate, one frame late,\n");
+                fprintf(stderr, "\t           or extrapolate[=<ms>], optionally this far ahead\n");
+                fprintf(stderr, "\t-O lock    send from a separate thread locked to the frame clock,\n");
+                fprintf(stderr, "\t           lock=<us> after each frame is expected, default %d\n", OUTPUT_LOCKDELAY);
+                fprintf(stderr, "\t-R <cpus>  real-time mode, lock memory and run the reading thread with\n");
+                fprintf(stderr, "\t           SCHED_FIFO on a CPU, <cpu>[,<output cpu>][:<priority>],\n");
+                fprintf(stderr, "\t           default priority %d, prints page faults and allocations\n", REALTIME_PRIORITY);
+                fprintf(stderr, "\t-L         print latency statistics on exit or SIGUSR1\n");
+                fprintf(stderr, "\t-e         print end-to-end latency and frame loss of emulator stamps\n");
+                fprintf(stderr, "\t-6         CT6B protocol, detected automatically by default\n");
+                fprintf(stderr, "\t-i         iBus protocol\n");
+                fprintf(stderr, "\t-s         SBUS protocol\n");
+                fprintf(stderr, "\t-c         CRSF / ExpressLRS protocol\n");
+                fprintf(stderr, "Options:\n" READER_USAGE SERIAL_USAGE);
+                exit(1);
+            }
+            if (opt == 'f') {
+                formatSet = true;
+            }
             break;
         }
     }
-    if (serial_port == NULL) {
+    if ((serial_port == NULL) && !readerReplaying(&reader)) {
         fprintf(stderr, "Serial port -p <port> must be specified\n");
         exit(1);
     }
+    if (upsampling && (!threaded || (outputRate == 0))) {
+        fprintf(stderr, "Upsampling -U needs a fixed output rate -O <Hz>\n");
+        exit(1);
+    }
+    sink = sinkFind(sinkName);
+    if (sink == NULL) {
+        fprintf(stderr, "Unknown sink %s, use one of: %s\n", sinkName, sinkNames());
+        exit(1);
+    }
+    if ((deadband != NULL) && (sinkSuppress(sink, deadband, keepAlive) != 0)) {
+        fprintf(stderr, "Invalid deadband %s\n", deadband);
+        exit(1);
+    }
+
+    // Also checks the profile, before anything is opened
+    if (foohidTransfer() != 0) {
+        exit(1);
+    }
+
+    // Without fixed line settings, detection also cycles through the protocol defaults
+    bool cycleLines = detect && (config.baud == 0) && !formatSet && !readerReplaying(&reader);
+
+    if (config.baud == 0) {
+        config.baud = lineDefaults[protocol].baud;
+    }
+    if (!formatSet) {
+        serialParseFormat(&config, lineDefaults[protocol].format);
+    }
 
     printf("Opening serial port...\n");
 
-    int fd = serialOpen(serial_port, BAUDRATE);
-    if (fd == -1) {
+    if (readerOpen(&reader, serial_port, &config) != 0) {
         fprintf(stderr, "failed to open serial port\n");
         exit(1);
     }
  
-    if (!debug) {
-        if (foohidInit() != 0) {
-            serialClose(fd);
-            fprintf(stderr, "failed to init foohid\n");
-            exit(1);
-        }
-    } else {
-        printf("Debug mode, no driver\n");
+    // The layout doesn't depend on the protocol, detection can't change it
+    struct sink_layout_t layout;
+    transferLayout(&transfer, &layout);
+    if (sinkOpen(sink, &layout) != 0) {
+        readerClose(&reader);
+        fprintf(stderr, "failed to init %s\n", sink->name);
+        exit(1);
     }
     if (signal(SIGINT, signalHandler) == SIG_ERR) {
         perror("Couldn't register signal handler");
         return 1;
     }
+    if ((measure || endToEnd || realtime) && (signal(SIGUSR1, statisticsHandler) == SIG_ERR)) {
+        perror("Couldn't register signal handler");
+        return 1;
+    }
+    latencyInit(&latency);
+    stampInit(&stamps);
+
+    // Before the output thread is created, so its stack is locked, too
+    if (realtime) {
+        if (realtimeStart(&rt) != 0) {
+            fprintf(stderr, "Real-time mode is incomplete\n");
+        }
+
+        // Even if memory couldn't be locked, map it now instead of in the loop.
+        // No other thread writes to these yet.
+        realtimePrefault(&output, sizeof(output));
+        realtimePrefault(&report, sizeof(report));
+        realtimePrefault(&latency, sizeof(latency));
+        realtimePrefault(&stamps, sizeof(stamps));
+        realtimePrefault(&arrivalJitter, sizeof(arrivalJitter));
+        if (!readerReplaying(&reader) && (reader.capturePath != NULL)) {
+            realtimePrefault(reader.capture.buffer, CAPTURE_BUFFER);
+        }
+#ifdef __linux__
+        if (!readerReplaying(&reader) && reader.uring) {
+            realtimePrefault(reader.ring.buffer, sizeof(reader.ring.buffer));
+        }
+#endif
+    }
 
-    printf("Entering main-loop...\n");
+    if (threaded && (outputStart(&output, foohidOutput, outputRate, lockDelay,
+            upsampling ? &upsample : NULL) != 0)) {
+        readerClose(&reader);
+        sinkClose(sink);
+        exit(1);
+    }
+    if (realtime && threaded) {
+        realtimeThread(&rt, output.thread, rt.outputCpu);
+    }
 
-    if (raw_ibus) {
-        enum {HDR_A, HDR_B, INT_LO, INT_HI, CHECK_A, CHECK_B} state = HDR_A;
-        uint16_t vals[IBUS_CHANNELS];
-        int channel = 0;
-        unsigned int chksum;
-        unsigned int wire_checksum;
+    if (detect) {
+        printf("Entering main-loop, detecting protocol...\n");
+    } else {
+        printf("Entering main-loop (%s)...\n", decoderName(protocol));
+    }
+
+    struct detector_t detector;
+    detectorInit(&detector);
+    struct decoder_t fixed;
+    decoderInit(&fixed, protocol);
+    struct decoder_t *decoder = detect ? NULL : &fixed;
+    uint64_t detectStart = serialTime();
+    int line = protocol;
+
+    struct decoder_frame_t frames[FRAMES];
+    unsigned long checksumErrors = 0;
+    unsigned long linkFrames = 0;
+    int failsafe = 0;
+
+    const int buffer_size = 1000;
+    unsigned char buffer[buffer_size];
+    if (realtime) {
+        realtimePrefault(buffer, buffer_size);
+        realtimePrefault(frames, sizeof(frames));
+        realtimePrefault(&detector, sizeof(detector));
+        realtimePrefault(&fixed, sizeof(fixed));
+    }
 
-        const int buffer_size = 1000;
-        unsigned char buffer[buffer_size];
+    // Filtering and the output thread need the arrival time of the frames
+    bool timed = measure || filtering || threaded;
 
-        while (running != 0) {
-            if (!serialHasChar(fd, 1)) {
-                continue;
+    while (running != 0) {
+        if (printStatistics) {
+            printStatistics = 0;
+            statisticsPrint(&reader, decoder);
+        }
+
+        // Sleep until data arrives, then drain everything available at once.
+        // When measuring, waiting separately tells when the data arrived.
+        uint64_t deadline = serialTime() + READTIMEOUT;
+        uint64_t readable = 0;
+        int bread = 0;
+        int ready = measure ? readerWait(&reader, deadline) : 1;
+        if (ready == 1) {
+            readable = measure ? latencyNow() : 0;
+            bread = readerRead(&reader, buffer, buffer_size, deadline);
+            if (timed && !measure) {
+                readable = latencyNow(); // best guess without waiting separately
             }
-            int bread = read(fd, buffer, buffer_size);
-
-            for (int ii = 0; ii < bread; ii++) {
-                unsigned char cc = buffer[ii];
-
-                switch (state) {
-                case HDR_A:
-                    if (cc == IBUS_HEADERBYTE_A) {
-                        state = HDR_B;
-                        chksum = 0xFFFF;
-                        chksum -= cc;
-                    }
-                    break;
-                case HDR_B:
-                    if (cc == IBUS_HEADERBYTE_B) {
-                        state = INT_LO;
-                        chksum -= cc;
-                    } else {
-                        state = HDR_A;
-                    }
-                    channel = 0;
-                    break;
-                case INT_LO:
-                    vals[channel] = cc;
-                    chksum -= cc;
-                    state = INT_HI;
-                    break;
-                case INT_HI:
-                    vals[channel++] |= ((int)cc) << 8;
-                    chksum -= cc;
-                    if (channel == IBUS_CHANNELS) {
-                        state = CHECK_A;
-                    } else {
-                        state = INT_LO;
-                    }
-                    break;
-                case CHECK_A:
-                    wire_checksum = cc;
-                    state = CHECK_B;
-                    break;
-                case CHECK_B:
-                    wire_checksum |= ((int)cc) << 8;
-                    if (wire_checksum == chksum) {
-                        foohidSend(vals, IBUS_CHANNELS, raw_ibus);
-                    } else {
-                        printf("bad checksum wire checksump %04x, checksum %04x\n", wire_checksum, chksum);
-                    }
-                    state = HDR_A;
-                    chksum = 0xFFFF;
-                    break;
-                }
+        }
+        if ((ready == -1) || (bread == -1)) {
+            break; // port lost or end of the capture
+        }
+        uint64_t stageStart = measure ? latencyNow() : 0;
+
+        if ((decoder == NULL) && cycleLines && ((serialTime() - detectStart) >= DETECTTIMEOUT)) {
+            // Nothing found, try the line settings of the next protocol
+            int previous = line;
+            do {
+                line = (line + 1) % PROTOCOL_COUNT;
+            } while ((lineDefaults[line].baud == lineDefaults[previous].baud)
+                    && (strcmp(lineDefaults[line].format, lineDefaults[previous].format) == 0));
+
+            config.baud = lineDefaults[line].baud;
+            serialParseFormat(&config, lineDefaults[line].format);
+            if (serialConfigure(reader.fd, &config) != 0) {
+                break;
             }
+
+            detectorInit(&detector);
+            detectStart = serialTime();
+            continue;
         }
-    } else {
-        while (running != 0) {
-            if (serialHasChar(fd, 0)) {
-                unsigned char c1;
-                serialReadChar(fd, (char*)&c1);
-                if (c1 == HEADERBYTE_A) {
-                    // Found first byte of protocol start
-                    while (!serialHasChar(fd, 0)) {
-                        if (running == 0) {
-                            serialClose(fd);
-                            return 0;
-                        }
-                    }
-
-                    unsigned char c2;
-                    serialReadChar(fd, (char*)&c2);
-                    if (c2 == HEADERBYTE_B) {
-                        // Protocol start has been found, read payload
-                        unsigned char data[PAYLOADBYTES];
-                        int read = 0;
-                        while ((read < PAYLOADBYTES) && (running != 0)) {
-                            read += serialReadRaw(fd, (char*)data + read, PAYLOADBYTES - read);
-                        }
-
-                        // Read 16bit checksum
-                        unsigned char checksumData[CHECKSUMBYTES];
-                        read = 0;
-                        while ((read < CHECKSUMBYTES) && (running != 0)) {
-                            read += serialReadRaw(fd, (char*)checksumData + read,
-                                    CHECKSUMBYTES - read);
-                        }
-
-                        // Check if checksum matches
-                        uint16_t checksum = 0;
-                        for (int i = 0; i < PAYLOADBYTES; i++) {
-                            checksum += data[i];
-                        }
-
-                        if (checksum != ((checksumData[0] << 8) | checksumData[1])) {
-                            printf("Wrong checksum: %d != %d\n",
-                                    checksum, ((checksumData[0] << 8) | checksumData[1]));
-                        } else {
-                            // Decode channel values
-                            uint16_t buff[CHANNELS + 1];
-                            for (int i = 0; i < (CHANNELS + 1); i++) {
-                                buff[i] = data[2 * i] << 8;
-                                buff[i] |= data[(2 * i) + 1];
-
-                                if (i < CHANNELS) {
-                                    buff[i] -= 1000;
-                                }
-                            }
-
-                            // Check Test Channel Value
-                            if (buff[CHANNELS] != buff[TESTCHANNEL]) {
-                                printf("Wrong test channel value: %d != %d\n",
-                                       buff[CHANNELS], buff[TESTCHANNEL]);
-                            }
-
-                            foohidSend(buff, CHANNELS, raw_ibus);
-                        }
-                    }
+
+        if (bread <= 0) {
+            continue;
+        }
+
+        int count;
+        if (decoder == NULL) {
+            count = detectorFeed(&detector, buffer, bread, frames, FRAMES);
+            decoder = detectorDecoder(&detector);
+            if (decoder == NULL) {
+                continue;
+            }
+
+            protocol = decoder->protocol;
+            foohidTransfer();
+            filterReset(&filter);
+            printf("Detected %s at %u baud %d%c%d\n", decoderName(protocol), config.baud,
+                    config.dataBits, config.parity, config.stopBits);
+        } else {
+            count = decoderFeed(decoder, buffer, bread, frames, FRAMES);
+        }
+
+        if (measure) {
+            uint64_t decoded = latencyNow();
+            latencyRecord(&latency, LATENCY_READ, readable, stageStart);
+            latencyRecord(&latency, LATENCY_DECODE, stageStart, decoded);
+        }
+
+        if (decoder->checksumErrors != checksumErrors) {
+            printf("bad checksum (%lu total, %lu frames recovered)\n", decoder->checksumErrors,
+                    decoder->resyncs);
+            checksumErrors = decoder->checksumErrors;
+        }
+
+        if (debug && ((decoder->linkFrames - linkFrames) >= LINKINTERVAL)) {
+            linkFrames = decoder->linkFrames;
+            printf("Link: RSSI -%ddBm / -%ddBm, LQ %d%%, SNR %ddB, RF mode %d\n",
+                    decoder->link.uplinkRssi1, decoder->link.uplinkRssi2,
+                    decoder->link.uplinkQuality, decoder->link.uplinkSnr,
+                    decoder->link.rfMode);
+        }
+
+        if (measure && (count > 0)) {
+            foohidArrival(readable, count);
+        }
+
+        for (int f = 0; f < count; f++) {
+            if ((frames[f].flags & DECODER_FLAG_FAILSAFE) != failsafe) {
+                failsafe = frames[f].flags & DECODER_FLAG_FAILSAFE;
+                printf("Receiver failsafe %s\n", failsafe ? "active" : "cleared");
+            }
+
+            uint32_t sequence;
+            uint64_t stamped;
+            bool hasStamp = endToEnd && (stampRead(&frames[f], &sequence, &stamped) == 0);
+
+            if ((protocol == PROTOCOL_CT6B) && (frames[f].flags & DECODER_FLAG_TESTCHANNEL)) {
+                printf("Wrong test channel value\n");
+            }
+
+            // After reading the stamp, smoothing would destroy it
+            if (filtering) {
+                uint64_t filterStart = measure ? latencyNow() : 0;
+                filterApply(&filter, &frames[f], readable);
+                if (measure) {
+                    latencyRecord(&latency, LATENCY_FILTER, filterStart, latencyNow());
                 }
             }
-            usleep(1000);
-        } 
+
+            struct mailbox_entry_t entry;
+            entry.frame = frames[f];
+            entry.time = readable;
+            if (threaded) {
+                outputPublish(&output, &entry);
+            } else {
+                foohidOutput(&entry);
+            }
+
+            if (hasStamp) {
+                stampRecord(&stamps, sequence, stamped, serialTime());
+            }
+        }
+
+        // From here on, nothing should fault or allocate anymore
+        if (realtime && !rt.steady && (decoder->frames >= REALTIME_WARMUP)) {
+            realtimeSteady(&rt);
+        }
     }
 
-    printf("Closing serial port...\n");
-    serialClose(fd);
-    if (!debug) {
-        foohidClose();
+    if (threaded) {
+        outputStop(&output);
+    }
+
+    statisticsPrint(&reader, decoder);
+    if (sink->suppress && !measure) {
+        printf("Suppressed %lu of %lu reports (%.1f%%)\n", sink->suppressed, sink->reports,
+                (sink->reports > 0) ? (100.0 * sink->suppressed / sink->reports) : 0.0);
+    }
+    if (upsampling && !measure) {
+        upsamplePrint(&output.upsample, stdout);
     }
 
+    printf("Closing serial port...\n");
+    readerClose(&reader);
+    sinkClose(sink);
+
     return 0;
 }
 
@@ -0,0 +1,94 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ *
+ * For more informations about HID report descriptors refer to:
+ * http://eleccelerator.com/tutorial-about-usb-hid-report-descriptors/
+ * http://www.usb.org/developers/hidpage#HID%20Descriptor%20Tool
+ */
+
+#include "hidreport.h"
+
+// Generic Desktop usages of the axes, in the order of sink_axis_t
+static const uint8_t axisUsages[SINK_AXES] = {
+    0x30, // X
+    0x31, // Y
+    0x32, // Z
+    0x33, // Rx
+    0x34, // Ry
+    0x35, // Rz
+    0x36, // Slider
+    0x37, // Dial
+};
+
+int hidDescriptor(const struct sink_layout_t *layout, uint8_t *descriptor) {
+    uint8_t *p = descriptor;
+    int axes = 0;
+
+    *p++ = 0x05; *p++ = 0x01;                     // USAGE_PAGE (Generic Desktop)
+    *p++ = 0x09; *p++ = 0x05;                     // USAGE (Game Pad)
+    *p++ = 0xa1; *p++ = 0x01;                     // COLLECTION (Application)
+
+    if (layout->axes != 0) {
+        *p++ = 0xa1; *p++ = 0x00;                 //   COLLECTION (Physical)
+        *p++ = 0x05; *p++ = 0x01;                 //     USAGE_PAGE (Generic Desktop)
+        for (int i = 0; i < SINK_AXES; i++) {
+            if (layout->axes & (1U << i)) {
+                *p++ = 0x09; *p++ = axisUsages[i]; //     USAGE (...)
+                axes++;
+            }
+        }
+        *p++ = 0x16;                              //     LOGICAL_MINIMUM (-511)
+        *p++ = (uint8_t)(-SINK_AXISMAXIMUM & 0xFF);
+        *p++ = (uint8_t)((-SINK_AXISMAXIMUM >> 8) & 0xFF);
+        *p++ = 0x26;                              //     LOGICAL_MAXIMUM (511)
+        *p++ = SINK_AXISMAXIMUM & 0xFF;
+        *p++ = (SINK_AXISMAXIMUM >> 8) & 0xFF;
+        *p++ = 0x75; *p++ = 16;                   //     REPORT_SIZE (16)
+        *p++ = 0x95; *p++ = axes;                 //     REPORT_COUNT (axes)
+        *p++ = 0x81; *p++ = 0x02;                 //     INPUT (Data,Var,Abs)
+        *p++ = 0xc0;                              //   END_COLLECTION
+    }
+
+    if (layout->buttons > 0) {
+        *p++ = 0x05; *p++ = 0x09;                 //   USAGE_PAGE (Button)
+        *p++ = 0x19; *p++ = 0x01;                 //   USAGE_MINIMUM (Button 1)
+        *p++ = 0x29; *p++ = layout->buttons;      //   USAGE_MAXIMUM (Button n)
+        *p++ = 0x15; *p++ = 0x00;                 //   LOGICAL_MINIMUM (0)
+        *p++ = 0x25; *p++ = 0x01;                 //   LOGICAL_MAXIMUM (1)
+        *p++ = 0x75; *p++ = 1;                    //   REPORT_SIZE (1)
+        *p++ = 0x95; *p++ = layout->buttons;      //   REPORT_COUNT (n)
+        *p++ = 0x81; *p++ = 0x02;                 //   INPUT (Data,Var,Abs)
+
+        if ((layout->buttons % 8) != 0) {
+            *p++ = 0x95; *p++ = 8 - (layout->buttons % 8); // REPORT_COUNT (padding)
+            *p++ = 0x81; *p++ = 0x03;             //   INPUT (Cnst,Var,Abs)
+        }
+    }
+
+    *p++ = 0xc0;                                  // END_COLLECTION
+    return (int)(p - descriptor);
+}
+
+int hidPack(const struct sink_layout_t *layout, const struct sink_report_t *report, uint8_t *data) {
+    uint8_t *p = data;
+
+    // HID reports are little endian, no matter the host
+    for (int i = 0; i < SINK_AXES; i++) {
+        if (layout->axes & (1U << i)) {
+            uint16_t value = (uint16_t)report->axes[i];
+            *p++ = value & 0xFF;
+            *p++ = value >> 8;
+        }
+    }
+
+    for (int i = 0; i < layout->buttons; i += 8) {
+        *p++ = (report->buttons >> i) & 0xFF;
+    }
+
+    return (int)(p - data);
+}
@@ -0,0 +1,59 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _HIDREPORT_H_
+#define _HIDREPORT_H_
+
+#include <stdint.h>
+
+#include "sink.h"
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Largest descriptor hidDescriptor() creates, in bytes.
+ */
+#define HID_DESCRIPTOR_MAX (44 + (2 * SINK_AXES))
+
+/*!
+ * \brief Largest report hidPack() creates, in bytes.
+ */
+#define HID_REPORT_MAX ((2 * SINK_AXES) + (SINK_BUTTONS / 8))
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief create a gamepad report descriptor
+ *
+ * Every axis in the layout becomes a signed 16 bit value, from
+ * -SINK_AXISMAXIMUM to SINK_AXISMAXIMUM, with the usages X, Y, Z,
+ * Rx, Ry, Rz, Slider and Dial in the order of sink_axis_t. The buttons
+ * follow as single bits, padded to a full byte.
+ *
+ * \param layout axes and buttons of the gamepad
+ * \param descriptor filled with at most HID_DESCRIPTOR_MAX bytes
+ * \returns length of the descriptor
+ */
+int hidDescriptor(const struct sink_layout_t *layout, uint8_t *descriptor);
+
+/*!
+ * \brief pack a report for a descriptor created by hidDescriptor()
+ * \param layout axes and buttons of the gamepad
+ * \param report values of all axes and buttons
+ * \param data filled with at most HID_REPORT_MAX bytes
+ * \returns length of the report
+ */
+int hidPack(const struct sink_layout_t *layout, const struct sink_report_t *report, uint8_t *data);
+
+#endif
+
@@ -0,0 +1,103 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#include "latency.h"
+
+static const char *stageNames[LATENCY_STAGES] = {
+    [LATENCY_READ] = "read",
+    [LATENCY_DECODE] = "decode",
+    [LATENCY_FILTER] = "filter",
+    [LATENCY_MAPPING] = "mapping",
+    [LATENCY_SEND] = "send",
+    [LATENCY_TOTAL] = "total",
+};
+
+void latencyInit(struct latency_t *l) {
+    memset(l, 0, sizeof(struct latency_t));
+}
+
+uint64_t latencyNow(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#endif
+}
+
+// Largest value falling into a bucket
+static uint64_t latencyBucketLimit(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t sub = bucket & (LATENCY_SUB_BUCKETS - 1);
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+uint64_t latencyPercentile(const struct latency_histogram_t *h, double percentile) {
+    if (h->count == 0) {
+        return 0;
+    }
+
+    // Rank of the wanted value, counting from 1
+    uint64_t rank = (uint64_t)((percentile / 100.0) * h->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > h->count) {
+        rank = h->count;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t limit = latencyBucketLimit(i);
+            return (limit < h->max) ? limit : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+const char *latencyStageName(enum latency_stage_t stage) {
+    if ((stage < 0) || (stage >= LATENCY_STAGES)) {
+        return "unknown";
+    }
+    return stageNames[stage];
+}
+
+void latencyPrint(const struct latency_t *l, FILE *out) {
+    fprintf(out, "%-8s %10s %10s %10s %10s %10s\n", "stage", "count",
+            "p50 us", "p99 us", "p99.9 us", "max us");
+
+    for (int i = 0; i < LATENCY_STAGES; i++) {
+        const struct latency_histogram_t *h = &l->stages[i];
+        fprintf(out, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", latencyStageName(i),
+                (unsigned long long)h->count,
+                latencyPercentile(h, 50.0) / 1000.0,
+                latencyPercentile(h, 99.0) / 1000.0,
+                latencyPercentile(h, 99.9) / 1000.0,
+                h->max / 1000.0);
+    }
+}
+
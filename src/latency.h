@@ -0,0 +1,161 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Linear sub-buckets per power of two, as a power of two.
+ *
+ * With 4 bits every bucket is at most 1/16 (6.25%) wide relative
+ * to its value, which is precise enough for percentiles.
+ */
+#define LATENCY_SUB_BITS 4
+
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS) //!< Sub-buckets per power of two
+
+/*!
+ * \brief Buckets needed to cover every 64 bit value.
+ */
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Measured stages of a frame, from reading to sending.
+ */
+enum latency_stage_t {
+    LATENCY_READ = 0, //!< port became readable until read() returned
+    LATENCY_DECODE,   //!< read() returned until the decoder returned
+    LATENCY_FILTER,   //!< filtering a single frame, if enabled
+    LATENCY_MAPPING,  //!< decoder returned until the report was filled
+    LATENCY_SEND,     //!< report filled until the send call returned
+    LATENCY_TOTAL,    //!< port became readable until the send call returned
+
+    LATENCY_STAGES
+};
+
+/*!
+ * \brief Log-linear histogram of durations in nanoseconds.
+ *
+ * Values below LATENCY_SUB_BUCKETS get a bucket each, above that
+ * every power of two is split into LATENCY_SUB_BUCKETS buckets.
+ * The memory needed is fixed and recording never allocates.
+ */
+struct latency_histogram_t {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint64_t count; //!< recorded values
+    uint64_t max; //!< largest recorded value
+};
+
+/*!
+ * \brief Histograms of all stages.
+ */
+struct latency_t {
+    struct latency_histogram_t stages[LATENCY_STAGES];
+};
+
+/*
+ * Measurement
+ */
+
+/*!
+ * \brief reset all histograms
+ * \param l latency statistics to clear
+ */
+void latencyInit(struct latency_t *l);
+
+/*!
+ * \brief get the current time with the best available resolution
+ * \returns monotonic clock in nanoseconds
+ */
+uint64_t latencyNow(void);
+
+/*!
+ * \brief get the histogram bucket of a value
+ * \param value duration in nanoseconds
+ * \returns bucket index
+ */
+static inline int latencyBucket(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - LATENCY_SUB_BITS;
+    return ((shift + 1) << LATENCY_SUB_BITS) + (int)((value >> shift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+/*!
+ * \brief add a value to a histogram
+ *
+ * Only a few instructions, so it is cheap enough to be called
+ * for every single frame.
+ *
+ * \param h histogram
+ * \param value duration in nanoseconds
+ */
+static inline void latencyAdd(struct latency_histogram_t *h, uint64_t value) {
+    h->buckets[latencyBucket(value)]++;
+    h->count++;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/*!
+ * \brief add a duration to the histogram of a stage
+ * \param l latency statistics
+ * \param stage stage that has been measured
+ * \param start latencyNow() at the start of the stage
+ * \param end latencyNow() at the end of the stage
+ */
+static inline void latencyRecord(struct latency_t *l, enum latency_stage_t stage,
+        uint64_t start, uint64_t end) {
+    latencyAdd(&l->stages[stage], (end > start) ? (end - start) : 0);
+}
+
+/*
+ * Evaluation
+ */
+
+/*!
+ * \brief get a percentile of a histogram
+ * \param h histogram to evaluate
+ * \param percentile between 0 and 100
+ * \returns upper bound of the bucket containing the percentile in
+ * nanoseconds, never larger than the maximum, 0 if h is empty
+ */
+uint64_t latencyPercentile(const struct latency_histogram_t *h, double percentile);
+
+/*!
+ * \brief get a human readable stage name
+ * \param stage stage to name
+ * \returns static string
+ */
+const char *latencyStageName(enum latency_stage_t stage);
+
+/*!
+ * \brief print p50, p99, p99.9 and maximum of every stage
+ * \param l latency statistics
+ * \param out stream to print to
+ */
+void latencyPrint(const struct latency_t *l, FILE *out);
+
+#endif
+
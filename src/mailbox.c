@@ -0,0 +1,62 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "mailbox.h"
+
+// Entry as words, for copying from and to the atomic words
+union mailbox_copy_t {
+    struct mailbox_entry_t entry;
+    uint32_t words[MAILBOX_WORDS];
+};
+
+void mailboxInit(struct mailbox_t *m) {
+    atomic_init(&m->sequence, 0);
+    for (size_t i = 0; i < MAILBOX_WORDS; i++) {
+        atomic_init(&m->words[i], 0);
+    }
+}
+
+void mailboxWrite(struct mailbox_t *m, const struct mailbox_entry_t *entry) {
+    union mailbox_copy_t copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.entry = *entry;
+
+    unsigned int sequence = atomic_load_explicit(&m->sequence, memory_order_relaxed);
+    atomic_store_explicit(&m->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // odd sequence before any word
+
+    for (size_t i = 0; i < MAILBOX_WORDS; i++) {
+        atomic_store_explicit(&m->words[i], copy.words[i], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&m->sequence, sequence + 2, memory_order_release);
+}
+
+unsigned int mailboxRead(struct mailbox_t *m, struct mailbox_entry_t *entry) {
+    union mailbox_copy_t copy;
+    unsigned int before, after;
+
+    do {
+        before = atomic_load_explicit(&m->sequence, memory_order_acquire);
+        for (size_t i = 0; i < MAILBOX_WORDS; i++) {
+            copy.words[i] = atomic_load_explicit(&m->words[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire); // every word before the check
+        after = atomic_load_explicit(&m->sequence, memory_order_relaxed);
+    } while ((before != after) || (before & 1));
+
+    if (before == 0) {
+        return 0;
+    }
+
+    *entry = copy.entry;
+    return before / 2;
+}
@@ -0,0 +1,79 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _MAILBOX_H_
+#define _MAILBOX_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "decoder.h"
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Contents of the mailbox.
+ */
+struct mailbox_entry_t {
+    struct decoder_frame_t frame; //!< latest decoded frame
+    uint64_t time; //!< latencyNow() when its data was received
+};
+
+/*!
+ * \brief Size of a mailbox_entry_t in words.
+ */
+#define MAILBOX_WORDS ((sizeof(struct mailbox_entry_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+/*!
+ * \brief Latest frame, handed from one writer to any number of readers.
+ *
+ * A sequence lock: the writer makes the sequence odd, copies the entry
+ * and makes it even again. Readers copy the entry and retry if the
+ * sequence was odd or changed meanwhile. Writing never waits for a
+ * reader, and a reader only ever waits for a copy of a few dozen bytes.
+ * The entry is stored in atomic words, so the copies are no data race.
+ */
+struct mailbox_t {
+    atomic_uint sequence; //!< twice the number of writes, odd while writing
+    atomic_uint words[MAILBOX_WORDS];
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief empty a mailbox
+ * \param m mailbox
+ */
+void mailboxInit(struct mailbox_t *m);
+
+/*!
+ * \brief replace the entry, never blocks
+ *
+ * Only one thread may write to a mailbox.
+ *
+ * \param m mailbox
+ * \param entry new entry
+ */
+void mailboxWrite(struct mailbox_t *m, const struct mailbox_entry_t *entry);
+
+/*!
+ * \brief copy the latest entry
+ * \param m mailbox
+ * \param entry filled with the latest entry
+ * \returns number of writes so far, 0 if entry has not been filled.
+ * Changes with every write, so it tells if there is a new entry.
+ */
+unsigned int mailboxRead(struct mailbox_t *m, struct mailbox_entry_t *entry);
+
+#endif
+
@@ -0,0 +1,228 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+#include "output.h"
+
+#define WAKEUPBYTES 64 // pipe bytes drained at once
+
+static void outputSleepUntil(uint64_t time) {
+    uint64_t now = latencyNow();
+    if (time <= now) {
+        return;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = (time - now) / 1000000000;
+    ts.tv_nsec = (time - now) % 1000000000;
+    nanosleep(&ts, NULL);
+}
+
+// Wait until the next entry is due, returns 0 when stopped
+static int outputWait(struct output_t *o, uint64_t *next) {
+    if ((o->period == 0) && !atomic_load(&o->locked)) {
+        unsigned char bytes[WAKEUPBYTES];
+        while (read(o->wakeup[0], bytes, sizeof(bytes)) == -1) {
+            if (errno != EINTR) {
+                return 0;
+            }
+        }
+    } else {
+        outputSleepUntil(*next);
+        uint64_t now = latencyNow();
+        latencyAdd(&o->late, (now > *next) ? (now - *next) : 0);
+
+        // Keep the schedule, but don't send a burst after falling behind.
+        // When locked, the next send depends on the frame, see outputThread().
+        if (o->period > 0) {
+            *next += o->period;
+            while (*next <= now) {
+                *next += o->period;
+                o->missed++;
+            }
+        }
+    }
+
+    return atomic_load(&o->running);
+}
+
+// Follow the frame clock with a new arrival, count frames since the last one
+static void outputTrack(struct output_t *o, uint64_t arrival, unsigned int count) {
+    if (o->lockFrames == 0) {
+        o->firstArrival = arrival;
+        o->lockFrames = 1;
+        return;
+    }
+    o->lockFrames += count;
+
+    // Average the first frames, frames from a single read arrive at the same time
+    if (!atomic_load(&o->locked)) {
+        if ((o->lockFrames > OUTPUT_LOCKFRAMES) && (arrival > o->firstArrival)) {
+            o->framePeriod = (double)(arrival - o->firstArrival) / (o->lockFrames - 1);
+            o->expected = arrival + o->framePeriod;
+            atomic_store(&o->locked, 1);
+        }
+        return;
+    }
+
+    double predicted = o->expected + ((count - 1) * o->framePeriod);
+    double error = (double)arrival - predicted;
+    latencyAdd(&o->phaseError, (error < 0.0) ? -error : error);
+
+    // After a pause, or a clock that jumped, the loop would take too long to catch up
+    if ((error > o->framePeriod) || (error < -o->framePeriod)) {
+        o->relocks++;
+        o->lockFrames = 0;
+        atomic_store(&o->locked, 0);
+        return;
+    }
+
+    predicted += OUTPUT_PHASEGAIN * error;
+    o->framePeriod += OUTPUT_PERIODGAIN * error;
+    o->expected = predicted + o->framePeriod;
+}
+
+static void *outputThread(void *arg) {
+    struct output_t *o = arg;
+    struct mailbox_entry_t entry;
+    unsigned int last = 0;
+    uint64_t next = latencyNow() + o->period;
+
+    while (outputWait(o, &next)) {
+        unsigned int sequence = mailboxRead(&o->mailbox, &entry);
+        if (sequence == 0) {
+            continue; // nothing received yet
+        }
+
+        int locked = atomic_load(&o->locked);
+        int fresh = (sequence != last);
+        if (fresh) {
+            o->replaced += sequence - last - 1;
+            upsampleFeed(&o->upsample, &entry, sequence - last);
+            if (o->lockDelay > 0) {
+                outputTrack(o, entry.time, sequence - last);
+            }
+            last = sequence;
+        } else if ((o->period == 0) && !locked) {
+            continue; // woken up for an entry already sent
+        } else if (locked) {
+            o->empty++; // frame late or lost, keep the grid
+        }
+
+        // The next send is due a fixed delay after the next frame should arrive,
+        // without a frame the grid just continues
+        if (atomic_load(&o->locked)) {
+            if (fresh) {
+                next = (uint64_t)o->expected + o->lockDelay;
+            } else {
+                uint64_t now = latencyNow();
+                do {
+                    next += (uint64_t)o->framePeriod;
+                } while (next <= now);
+            }
+        }
+
+        // Keeps the arrival time of the latest frame, for the latency statistics
+        upsampleAt(&o->upsample, latencyNow(), &entry.frame);
+
+        o->send(&entry);
+        o->sent++;
+    }
+
+    return NULL;
+}
+
+int outputStart(struct output_t *o, output_send_t send, unsigned int rate, unsigned int lock,
+        const struct upsample_t *upsample) {
+    memset(o, 0, sizeof(struct output_t));
+    mailboxInit(&o->mailbox);
+    if (upsample != NULL) {
+        o->upsample = *upsample;
+    }
+    o->send = send;
+    o->period = (rate > 0) ? (1000000000ULL / rate) : 0;
+    atomic_init(&o->running, 1);
+    o->lockDelay = (rate == 0) ? (lock * 1000ULL) : 0;
+    atomic_init(&o->locked, 0);
+
+    // Publishing must never block, even if the output thread hangs
+    if (pipe(o->wakeup) != 0) {
+        perror("Couldn't create output pipe");
+        return -1;
+    }
+    fcntl(o->wakeup[1], F_SETFL, fcntl(o->wakeup[1], F_GETFL) | O_NONBLOCK);
+
+    // Signals are handled by the reading thread only
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    int ret = pthread_create(&o->thread, NULL, outputThread, o);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (ret != 0) {
+        fprintf(stderr, "Couldn't start output thread\n");
+        close(o->wakeup[0]);
+        close(o->wakeup[1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+void outputPublish(struct output_t *o, const struct mailbox_entry_t *entry) {
+    mailboxWrite(&o->mailbox, entry);
+
+    // Once locked, the output thread wakes up on its own
+    if ((o->period == 0) && !atomic_load_explicit(&o->locked, memory_order_relaxed)) {
+        unsigned char byte = 0;
+        if (write(o->wakeup[1], &byte, 1) != 1) {
+            // Pipe full, a wakeup is pending anyway
+        }
+    }
+}
+
+void outputStop(struct output_t *o) {
+    atomic_store(&o->running, 0);
+    close(o->wakeup[1]); // wakes the output thread with end of file
+    pthread_join(o->thread, NULL);
+    close(o->wakeup[0]);
+}
+
+void outputPrint(const struct output_t *o, FILE *out) {
+    fprintf(out, "Output: %lu sent, %lu replaced before sending", o->sent, o->replaced);
+    if ((o->period > 0) || (o->lockDelay > 0)) {
+        fprintf(out, ", %lu missed\n", o->missed);
+        fprintf(out, "Output late: p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+                latencyPercentile(&o->late, 50.0) / 1000.0,
+                latencyPercentile(&o->late, 99.0) / 1000.0,
+                latencyPercentile(&o->late, 99.9) / 1000.0,
+                o->late.max / 1000.0);
+    } else {
+        fprintf(out, "\n");
+    }
+
+    if (o->period > 0) {
+        upsamplePrint(&o->upsample, out);
+    }
+    if (o->lockDelay > 0) {
+        fprintf(out, "Locked: %s, frames every %.3fms, %lu without a new frame, %lu relocks\n",
+                atomic_load(&o->locked) ? "yes" : "no", o->framePeriod / 1e6, o->empty, o->relocks);
+        fprintf(out, "Phase error: p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+                latencyPercentile(&o->phaseError, 50.0) / 1000.0,
+                latencyPercentile(&o->phaseError, 99.0) / 1000.0,
+                latencyPercentile(&o->phaseError, 99.9) / 1000.0,
+                o->phaseError.max / 1000.0);
+    }
+}
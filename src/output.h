@@ -0,0 +1,121 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "latency.h"
+#include "mailbox.h"
+#include "upsample.h"
+
+/*
+ * Configuration
+ */
+
+#define OUTPUT_LOCKDELAY 2000 //!< Default us a locked send waits after the expected frame
+#define OUTPUT_LOCKFRAMES 8 //!< Frames averaged for the first period estimate
+
+/*!
+ * \brief Part of the phase error corrected in the phase and in the period with every frame.
+ *
+ * A second order loop with a damping of about 0.7, settling within a few dozen frames.
+ */
+#define OUTPUT_PHASEGAIN (1.0 / 8.0)
+#define OUTPUT_PERIODGAIN (1.0 / 128.0) //!< see OUTPUT_PHASEGAIN
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Sends one entry, called from the output thread.
+ */
+typedef void (*output_send_t)(const struct mailbox_entry_t *entry);
+
+/*!
+ * \brief Output thread state.
+ *
+ * The reading thread only puts the latest frame into the mailbox and
+ * never waits for the output. The output thread either sends whatever
+ * is in the mailbox at a fixed rate, or wakes up on every new entry.
+ * At a fixed rate, the reports between two frames can be upsampled.
+ *
+ * When locked, a phase-locked loop follows the clock of the transmitter
+ * from the arrival times, and each frame is sent a fixed delay after it
+ * was expected. The reports go out at the frame rate of the transmitter,
+ * but without the jitter of the serial line and the host.
+ */
+struct output_t {
+    struct mailbox_t mailbox; //!< written by the reading thread
+    output_send_t send;
+    uint64_t period; //!< ns between two sends, 0 to send every new entry
+    int wakeup[2]; //!< pipe, a byte is written for every new entry
+    pthread_t thread;
+    atomic_int running; //!< cleared to stop the output thread
+    struct upsample_t upsample; //!< only touched by the output thread
+
+    uint64_t lockDelay; //!< ns from the expected arrival until sending, 0 if not locked
+    atomic_int locked; //!< the frame clock is known, no wakeups needed
+    double framePeriod; //!< estimated ns between two frames of the transmitter
+    double expected; //!< latencyNow() the next frame should arrive
+    uint64_t firstArrival; //!< start of the first period estimate
+    unsigned long lockFrames; //!< frames since locking started
+
+    unsigned long sent; //!< entries sent
+    unsigned long replaced; //!< entries overwritten before being sent
+    unsigned long missed; //!< fixed rate sends skipped, thread was too late
+    struct latency_histogram_t late; //!< wakeup after the scheduled time
+    unsigned long empty; //!< locked sends without a new frame
+    unsigned long relocks; //!< frames too far off to follow, the lock started over
+    struct latency_histogram_t phaseError; //!< arrival against the expected time
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief start the output thread
+ * \param o output state to initialize
+ * \param send called with every entry to send
+ * \param rate sends per second, 0 to send every new entry or to lock
+ * \param lock us from the expected arrival of a frame until it is sent, 0 not to lock, needs rate 0
+ * \param upsample how reports between frames are created, see upsampleParse(), NULL to repeat frames
+ * \returns 0 on success, -1 on error
+ */
+int outputStart(struct output_t *o, output_send_t send, unsigned int rate, unsigned int lock,
+        const struct upsample_t *upsample);
+
+/*!
+ * \brief hand a new entry to the output thread, never blocks
+ * \param o output state
+ * \param entry latest frame
+ */
+void outputPublish(struct output_t *o, const struct mailbox_entry_t *entry);
+
+/*!
+ * \brief stop the output thread, after it finished sending
+ * \param o output state
+ */
+void outputStop(struct output_t *o);
+
+/*!
+ * \brief print sent and replaced entries, the wakeup lateness and the prediction error
+ * \param o output state
+ * \param out stream to print to
+ */
+void outputPrint(const struct output_t *o, FILE *out);
+
+#endif
+
@@ -13,16 +13,12 @@
 #include <unistd.h>
 
 #include "serial.h"
+#include "decoder.h"
+#include "reader.h"
 
 #define BAUDRATE 115200
-#define PACKETSIZE 18
-#define HEADERBYTES 2
-#define HEADERBYTE_A 85
-#define HEADERBYTE_B 252
-#define CHECKSUMBYTES 2
-#define PAYLOADBYTES (PACKETSIZE - HEADERBYTES - CHECKSUMBYTES)
-#define CHANNELS 6
-#define TESTCHANNEL 2
+#define READTIMEOUT 100000 // us, only bounds the reaction time to SIGINT
+#define FRAMES 16
 
 static int running = 1;
 
@@ -31,15 +27,30 @@ static void signalHandler(int signo) {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage:\n\t%s /dev/serial_port\n", argv[0]);
+    struct serial_config_t config;
+    serialDefaultConfig(&config, BAUDRATE);
+
+    struct reader_t reader;
+    readerInit(&reader);
+
+    int opt;
+    while ((opt = getopt(argc, argv, READER_OPTIONS SERIAL_OPTIONS)) != -1) {
+        if ((readerParseOption(&reader, opt, optarg) != 1)
+                && (serialParseOption(&config, opt, optarg) != 1)) {
+            return 1;
+        }
+    }
+
+    if ((argc - optind) != (readerReplaying(&reader) ? 0 : 1)) {
+        printf("Usage:\n\t%s [options] /dev/serial_port\n", argv[0]);
+        printf("\t%s [options] -r <file>\n", argv[0]);
+        printf("Options:\n" READER_USAGE SERIAL_USAGE);
         return 1;
     }
 
     printf("Opening serial port...\n");
 
-    int fd = serialOpen(argv[1], BAUDRATE);
-    if (fd == -1) {
+    if (readerOpen(&reader, argv[optind], &config) != 0) {
         return 1;
     }
 
@@ -51,80 +62,54 @@ int main(int argc, char* argv[]) {
     }
 
     printf("opened ...\n");
+
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_CT6B);
+    struct decoder_frame_t frames[FRAMES];
+    unsigned long checksumErrors = 0;
+
+    const int buffer_size = 256;
+    unsigned char buffer[buffer_size];
+
     while (running != 0) {
-        if (serialHasChar(fd, 1)) {
-            unsigned char c1;
-            serialReadChar(fd, (char*)&c1);
-            printf("read %2x (%2d)\n", c1, c1);
-            if (c1 == HEADERBYTE_A) {
-                // Found first byte of protocol start
-                while (!serialHasChar(fd, 1)) {
-                    if (running == 0) {
-                        serialClose(fd);
-                        return 0;
-                    }
-                }
-
-                unsigned char c2;
-                serialReadChar(fd, (char*)&c2);
-                if (c2 == HEADERBYTE_B) {
-                    // Protocol start has been found, read payload
-                    unsigned char data[PAYLOADBYTES];
-                    int read = 0;
-                    while ((read < PAYLOADBYTES) && (running != 0)) {
-                        read += serialReadRaw(fd, (char*)data + read, PAYLOADBYTES - read);
-                    }
-
-                    // Read 16bit checksum
-                    unsigned char checksumData[CHECKSUMBYTES];
-                    read = 0;
-                    while ((read < CHECKSUMBYTES) && (running != 0)) {
-                        read += serialReadRaw(fd, (char*)checksumData + read,
-                                              CHECKSUMBYTES - read);
-                    }
-
-                    // Check if checksum matches
-                    uint16_t checksum = 0;
-                    for (int i = 0; i < PAYLOADBYTES; i++) {
-                        checksum += data[i];
-                    }
-
-                    if (checksum != ((checksumData[0] << 8) | checksumData[1])) {
-                        printf("Wrong checksum: %d != %d\n",
-                               checksum, ((checksumData[0] << 8) | checksumData[1]));
-                    } else {
-                        // Decode channel values
-                        uint16_t buff[CHANNELS + 1];
-                        for (int i = 0; i < (CHANNELS + 1); i++) {
-                            buff[i] = data[2 * i] << 8;
-                            buff[i] |= data[(2 * i) + 1];
-
-                            if (i < CHANNELS) {
-                                buff[i] -= 1000;
-                            }
-                        }
-
-                        // Check Test Channel Value
-                        if (buff[CHANNELS] != buff[TESTCHANNEL]) {
-                            printf("Wrong test channel value: %d != %d\n",
-                                   buff[CHANNELS], buff[TESTCHANNEL]);
-                        }
-
-                        for (int i = 0; i < CHANNELS; i++) {
-                            printf("CH%d: %d\n", i + 1, buff[i]);
-                        }
-
-                        for (int i = 0; i < CHANNELS; i++) {
-                            printf("\r\033[1A");
-                        }
-                    }
-                }
+        int bread = readerRead(&reader, buffer, buffer_size, serialTime() + READTIMEOUT);
+        if (bread <= 0) {
+            if (bread == -1) {
+                break; // port lost or end of the capture
             }
+            continue;
+        }
+
+        int count = decoderFeed(&decoder, buffer, bread, frames, FRAMES);
+
+        if (decoder.checksumErrors != checksumErrors) {
+            printf("Wrong checksum (%lu total, %lu frames recovered)\n", decoder.checksumErrors,
+                    decoder.resyncs);
+            checksumErrors = decoder.checksumErrors;
+        }
+
+        if (count == 0) {
+            continue;
+        }
+
+        // Only the newest frame is of interest for the display
+        struct decoder_frame_t *frame = &frames[count - 1];
+
+        if (frame->flags & DECODER_FLAG_TESTCHANNEL) {
+            printf("Wrong test channel value\n");
+        }
+
+        for (int i = 0; i < CT6B_CHANNELS; i++) {
+            printf("CH%d: %d\n", i + 1, frame->channels[i] - 1000);
+        }
+
+        for (int i = 0; i < CT6B_CHANNELS; i++) {
+            printf("\r\033[1A");
         }
     }
 
     printf("Closing serial port...                    \n");
-    serialClose(fd);
+    readerClose(&reader);
 
     return 0;
 }
@@ -17,12 +17,12 @@
 #include <unistd.h>
 
 #include "serial.h"
+#include "decoder.h"
+#include "reader.h"
 
 #define BAUDRATE 115200
-#define IBUS_HEADERBYTES 2
-#define IBUS_HEADERBYTE_A 0x20
-#define IBUS_HEADERBYTE_B 0x40
-#define IBUS_CHANNELS 14
+#define READTIMEOUT 100000 // us, only bounds the reaction time to SIGINT
+#define FRAMES 32
 
 static int running = 1;
 
@@ -31,13 +31,29 @@ static void signalHandler(int signo) {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage:\n\t%s /dev/serial_port\n", argv[0]);
+    struct serial_config_t config;
+    serialDefaultConfig(&config, BAUDRATE);
+
+    struct reader_t reader;
+    readerInit(&reader);
+
+    int opt;
+    while ((opt = getopt(argc, argv, READER_OPTIONS SERIAL_OPTIONS)) != -1) {
+        if ((readerParseOption(&reader, opt, optarg) != 1)
+                && (serialParseOption(&config, opt, optarg) != 1)) {
+            return 1;
+        }
+    }
+
+    if ((argc - optind) != (readerReplaying(&reader) ? 0 : 1)) {
+        printf("Usage:\n\t%s [options] /dev/serial_port\n", argv[0]);
+        printf("\t%s [options] -r <file>\n", argv[0]);
+        printf("Options:\n" READER_USAGE SERIAL_USAGE);
         return 1;
     }
+
     printf("Opening serial port...\n");
-    int fd = serialOpen(argv[1], BAUDRATE);
-    if (fd == -1) {
+    if (readerOpen(&reader, argv[optind], &config) != 0) {
         return 1;
     }
     printf("port open ...\n");
@@ -46,87 +62,51 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    enum {HDR_A, HDR_B, INT_LO, INT_HI, CHECK_A, CHECK_B} state = HDR_A;
-    int vals[IBUS_CHANNELS];
-    int lasts[IBUS_CHANNELS];
-    int channel = 0;
-    unsigned int chksum;
-    unsigned int wire_checksum;
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_IBUS);
+    struct decoder_frame_t frames[FRAMES];
+    int lasts[IBUS_CHANNELS] = { 0 };
+    unsigned long checksumErrors = 0;
 
     const int buffer_size = 1000;
     unsigned char buffer[buffer_size];
 
     int wcount = 0;
     while (running != 0) {
-        if (!serialHasChar(fd, 1)) {
+        int bread = readerRead(&reader, buffer, buffer_size, serialTime() + READTIMEOUT);
+        if (bread <= 0) {
+            if (bread == -1) {
+                break; // port lost or end of the capture
+            }
             continue;
         }
-        int bread = read(fd, buffer, buffer_size);
 
-        for (int ii = 0; ii < bread; ii++) {
-            unsigned char cc = buffer[ii];
+        int count = decoderFeed(&decoder, buffer, bread, frames, FRAMES);
 
-            switch (state) {
-            case HDR_A:
-                if (cc == IBUS_HEADERBYTE_A) {
-                    state = HDR_B;
-                    chksum = 0xFFFF;
-                    chksum -= cc;
-                }
-                break;
-            case HDR_B:
-                if (cc == IBUS_HEADERBYTE_B) {
-                    state = INT_LO;
-                    chksum -= cc;
-                } else {
-                    state = HDR_A;
-                }
-                channel = 0;
-                break;
-            case INT_LO:
-                vals[channel] = cc;
-                chksum -= cc;
-                state = INT_HI;
-                break;
-            case INT_HI:
-                vals[channel++] |= ((int)cc) << 8;
-                chksum -= cc;
-                if (channel == IBUS_CHANNELS) {
-                    state = CHECK_A;
-                } else {
-                    state = INT_LO;
+        if (decoder.checksumErrors != checksumErrors) {
+            printf("bad checksum (%lu total, %lu frames recovered)\n", decoder.checksumErrors,
+                    decoder.resyncs);
+            checksumErrors = decoder.checksumErrors;
+        }
+
+        for (int f = 0; f < count; f++) {
+            uint16_t *vals = frames[f].channels;
+            if (wcount++ > 10) {
+                for (int ii = 0; ii < IBUS_CHANNELS; ii++) {
+                    printf("%8x ", vals[ii]);
                 }
-                break;
-            case CHECK_A:
-                wire_checksum = cc;
-                state = CHECK_B;
-                break;
-            case CHECK_B:
-                wire_checksum |= ((int)cc) << 8;
-                if (wire_checksum == chksum) {
-                    if (wcount++ > 10) {
-                        for (int ii = 0; ii < IBUS_CHANNELS; ii++) {
-                            printf("%8x ", vals[ii]);
-                        }
-                        printf("\n");
-                        for (int ii = 0; ii < IBUS_CHANNELS; ii++) {
-                            printf("%8d ", vals[ii] - lasts[ii]);
-                            lasts[ii] = vals[ii];
-                        }
-                        printf("\n");
-                        wcount = 0;
-                    }
-                } else {
-                    printf("bad checksum wire checksump %04x, checksum %04x\n", wire_checksum, chksum);
+                printf("\n");
+                for (int ii = 0; ii < IBUS_CHANNELS; ii++) {
+                    printf("%8d ", vals[ii] - lasts[ii]);
+                    lasts[ii] = vals[ii];
                 }
-                state = HDR_A;
-                chksum = 0xFFFF;
-                break;
+                printf("\n");
+                wcount = 0;
             }
         }
     }
     printf("Closing serial port...                    \n");
-    serialClose(fd);
+    readerClose(&reader);
     return 0;
 }
 
@@ -0,0 +1,114 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "serial.h"
+#include "decoder.h"
+#include "reader.h"
+
+#define BAUDRATE 100000
+#define FORMAT "8E2"
+#define READTIMEOUT 100000 // us, only bounds the reaction time to SIGINT
+#define FRAMES 32
+
+static int running = 1;
+
+static void signalHandler(int signo) {
+    running = 0;
+}
+
+int main(int argc, char* argv[]) {
+    struct serial_config_t config;
+    serialDefaultConfig(&config, BAUDRATE);
+    serialParseFormat(&config, FORMAT);
+
+    struct reader_t reader;
+    readerInit(&reader);
+
+    int opt;
+    while ((opt = getopt(argc, argv, READER_OPTIONS SERIAL_OPTIONS)) != -1) {
+        if ((readerParseOption(&reader, opt, optarg) != 1)
+                && (serialParseOption(&config, opt, optarg) != 1)) {
+            return 1;
+        }
+    }
+
+    if ((argc - optind) != (readerReplaying(&reader) ? 0 : 1)) {
+        printf("Usage:\n\t%s [options] /dev/serial_port\n", argv[0]);
+        printf("\t%s [options] -r <file>\n", argv[0]);
+        printf("Options:\n" READER_USAGE SERIAL_USAGE);
+        return 1;
+    }
+
+    printf("Opening serial port...\n");
+    if (readerOpen(&reader, argv[optind], &config) != 0) {
+        return 1;
+    }
+    printf("port open ...\n");
+    if (signal(SIGINT, signalHandler) == SIG_ERR) {
+        perror("Couldn't register signal handler");
+        return 1;
+    }
+
+    struct decoder_t decoder;
+    decoderInit(&decoder, PROTOCOL_SBUS);
+    struct decoder_frame_t frames[FRAMES];
+    int lasts[SBUS_CHANNELS] = { 0 };
+    unsigned long badFrames = 0;
+
+    const int buffer_size = 1000;
+    unsigned char buffer[buffer_size];
+
+    int wcount = 0;
+    while (running != 0) {
+        int bread = readerRead(&reader, buffer, buffer_size, serialTime() + READTIMEOUT);
+        if (bread <= 0) {
+            if (bread == -1) {
+                break; // port lost or end of the capture
+            }
+            continue;
+        }
+
+        int count = decoderFeed(&decoder, buffer, bread, frames, FRAMES);
+
+        if (decoder.checksumErrors != badFrames) {
+            printf("bad end byte (%lu total, %lu frames recovered)\n", decoder.checksumErrors,
+                    decoder.resyncs);
+            badFrames = decoder.checksumErrors;
+        }
+
+        for (int f = 0; f < count; f++) {
+            uint16_t *vals = frames[f].channels;
+            if (wcount++ > 10) {
+                for (int ii = 0; ii < SBUS_CHANNELS; ii++) {
+                    printf("%5d ", vals[ii]);
+                }
+                printf("%s%s%s%s\n",
+                        (frames[f].flags & DECODER_FLAG_CH17) ? " CH17" : "",
+                        (frames[f].flags & DECODER_FLAG_CH18) ? " CH18" : "",
+                        (frames[f].flags & DECODER_FLAG_FRAMELOST) ? " LOST" : "",
+                        (frames[f].flags & DECODER_FLAG_FAILSAFE) ? " FAILSAFE" : "");
+                for (int ii = 0; ii < SBUS_CHANNELS; ii++) {
+                    printf("%5d ", vals[ii] - lasts[ii]);
+                    lasts[ii] = vals[ii];
+                }
+                printf("\n");
+                wcount = 0;
+            }
+        }
+    }
+    printf("Closing serial port...                    \n");
+    readerClose(&reader);
+    return 0;
+}
+
@@ -0,0 +1,199 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reader.h"
+
+void readerInit(struct reader_t *r) {
+    r->fd = -1;
+    r->capturePath = NULL;
+    r->replayPath = NULL;
+    r->fast = 0;
+    r->uring = 0;
+    r->spin = 0;
+    r->pause = 0;
+    r->syscalls = 0;
+#ifdef __linux__
+    r->ring.ring = -1;
+#endif
+}
+
+int readerParseOption(struct reader_t *r, int opt, const char *arg) {
+    char *end;
+    long value;
+
+    switch (opt) {
+    case 'w':
+        r->capturePath = arg;
+        return 1;
+    case 'r':
+        r->replayPath = arg;
+        return 1;
+    case 'a':
+        r->fast = 1;
+        return 1;
+    case 'u':
+        r->uring = 1;
+        return 1;
+    case 'y':
+        value = strtol(arg, &end, 10);
+        if ((end == arg) || (value <= 0) || (value > 1000000)
+                || ((*end != '\0') && (strcmp(end, ",pause") != 0))) {
+            fprintf(stderr, "Invalid busy polling time \"%s\"\n", arg);
+            return -1;
+        }
+        r->spin = value;
+        r->pause = (*end != '\0');
+        return 1;
+    }
+    return 0;
+}
+
+int readerReplaying(const struct reader_t *r) {
+    return r->replayPath != NULL;
+}
+
+int readerOpen(struct reader_t *r, const char *port, struct serial_config_t *config) {
+    if (readerReplaying(r)) {
+        if (replayOpen(&r->replay, r->replayPath, r->fast) != 0) {
+            return -1;
+        }
+        replayConfig(&r->replay, config);
+        return 0;
+    }
+
+    r->fd = serialOpenConfig(port, config);
+    if (r->fd == -1) {
+        return -1;
+    }
+
+    // io_uring sleeps in the kernel, there is nothing to spin on
+    if (r->uring && (r->spin > 0)) {
+        fprintf(stderr, "Not busy polling with io_uring\n");
+        r->spin = 0;
+    }
+    if ((r->spin > 0) && ((config->vmin > 0) || (config->vtime > 0))) {
+        fprintf(stderr, "Not busy polling with blocking reads\n");
+        r->spin = 0;
+    }
+
+    // Without io_uring, poll() still works
+#ifdef __linux__
+    if (r->uring && (uringOpen(&r->ring, r->fd) != 0)) {
+        fprintf(stderr, "Using poll() instead of io_uring\n");
+        r->uring = 0;
+    }
+#else
+    if (r->uring) {
+        fprintf(stderr, "io_uring is only available on Linux, using poll()\n");
+        r->uring = 0;
+    }
+#endif
+
+    if (r->capturePath != NULL) {
+        // The capture cleaned up after itself, only the port is left
+        if (captureOpen(&r->capture, r->capturePath, config) != 0) {
+#ifdef __linux__
+            if (r->uring) {
+                uringClose(&r->ring);
+            }
+#endif
+            serialClose(r->fd);
+            r->fd = -1;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int readerWait(struct reader_t *r, uint64_t deadline) {
+    if (readerReplaying(r)) {
+        return replayWait(&r->replay, deadline);
+    }
+#ifdef __linux__
+    if (r->uring) {
+        return uringWait(&r->ring, deadline);
+    }
+#endif
+    if (r->spin > 0) {
+        return serialSpinWait(r->fd, deadline, r->spin, r->pause, &r->syscalls);
+    }
+    r->syscalls++;
+    return serialWait(r->fd, deadline);
+}
+
+int readerRead(struct reader_t *r, unsigned char *data, int length, uint64_t deadline) {
+    if (readerReplaying(r)) {
+        return replayRead(&r->replay, data, length, deadline);
+    }
+
+    int ret;
+#ifdef __linux__
+    if (r->uring) {
+        ret = uringRead(&r->ring, data, length, deadline);
+    } else if (r->spin > 0) {
+        ret = serialSpinRead(r->fd, (char *)data, length, deadline, r->spin, r->pause,
+                &r->syscalls);
+    } else {
+        ret = serialReadCount(r->fd, (char *)data, length, deadline, &r->syscalls);
+    }
+#else
+    if (r->spin > 0) {
+        ret = serialSpinRead(r->fd, (char *)data, length, deadline, r->spin, r->pause,
+                &r->syscalls);
+    } else {
+        ret = serialReadCount(r->fd, (char *)data, length, deadline, &r->syscalls);
+    }
+#endif
+    if ((ret > 0) && (r->capturePath != NULL)) {
+        captureWrite(&r->capture, serialTime(), data, ret);
+    }
+    return ret;
+}
+
+const char *readerBackend(const struct reader_t *r) {
+    if (readerReplaying(r)) {
+        return "replay";
+    }
+    if (r->uring) {
+        return "io_uring";
+    }
+    return (r->spin > 0) ? "spin" : "poll";
+}
+
+unsigned long readerSyscalls(const struct reader_t *r) {
+#ifdef __linux__
+    if (r->uring) {
+        return r->ring.syscalls;
+    }
+#endif
+    return r->syscalls;
+}
+
+void readerClose(struct reader_t *r) {
+    if (readerReplaying(r)) {
+        replayClose(&r->replay);
+        return;
+    }
+
+    if (r->capturePath != NULL) {
+        captureClose(&r->capture);
+    }
+#ifdef __linux__
+    if (r->uring) {
+        uringClose(&r->ring);
+    }
+#endif
+    serialClose(r->fd);
+}
+
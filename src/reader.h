@@ -0,0 +1,135 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _READER_H_
+#define _READER_H_
+
+#include <stdint.h>
+
+#include "serial.h"
+#include "capture.h"
+
+#ifdef __linux__
+#include "uring.h"
+#endif
+
+/*!
+ * \brief Source of received data for the decoders.
+ *
+ * Either a serial port, optionally captured to a file, or the
+ * replay of such a capture file. The port is waited for with poll(),
+ * optionally after busy polling it for a while, or on Linux read with
+ * io_uring.
+ */
+struct reader_t {
+    int fd; //!< serial port, -1 while replaying
+    const char *capturePath; //!< file to capture to, or NULL
+    const char *replayPath; //!< file to replay, or NULL
+    int fast; //!< replay as fast as possible
+    int uring; //!< read the port with io_uring instead of poll()
+    unsigned int spin; //!< microseconds to busy poll the port before sleeping, 0 to never spin
+    int pause; //!< execute pause instructions while busy polling
+    unsigned long syscalls; //!< system calls made by poll() waiting and reading
+    struct capture_t capture;
+    struct replay_t replay;
+#ifdef __linux__
+    struct uring_t ring;
+#endif
+};
+
+/*!
+ * \brief getopt() option string for capturing and replaying.
+ */
+#define READER_OPTIONS "w:r:auy:"
+
+/*!
+ * \brief Usage text describing READER_OPTIONS.
+ */
+#define READER_USAGE \
+    "\t-w <file>   capture all received data to file\n" \
+    "\t-r <file>   replay a capture instead of opening a port\n" \
+    "\t-a         replay as fast as possible, not with the captured timing\n" \
+    "\t-u         read the port with io_uring instead of poll(), Linux only\n" \
+    "\t-y <us>     busy poll the port this long before sleeping, keeps a CPU busy,\n" \
+    "\t           <us>,pause to execute pause instructions while spinning\n"
+
+/*!
+ * \brief prepare a reader, to be followed by readerParseOption() and readerOpen()
+ * \param r reader to initialize
+ */
+void readerInit(struct reader_t *r);
+
+/*!
+ * \brief apply one of the READER_OPTIONS returned by getopt()
+ * \param r reader to modify
+ * \param opt option character
+ * \param arg option argument
+ * \returns 1 if opt has been handled, 0 if it is no reader option,
+ * -1 if the argument is invalid
+ */
+int readerParseOption(struct reader_t *r, int opt, const char *arg);
+
+/*!
+ * \brief check if a capture file is replayed
+ * \param r reader
+ * \returns 1 while replaying, 0 for a serial port
+ */
+int readerReplaying(const struct reader_t *r);
+
+/*!
+ * \brief open the serial port or the replayed file
+ * \param r reader
+ * \param port name of the port, unused while replaying
+ * \param config line settings, replaced by the captured ones while replaying
+ * \returns 0 on success, -1 on error
+ */
+int readerOpen(struct reader_t *r, const char *port, struct serial_config_t *config);
+
+/*!
+ * \brief wait until data can be read, like serialWait()
+ * \param r reader
+ * \param deadline when to give up, see serialTime()
+ * \returns 1 if data is available, 0 on timeout or signal,
+ * -1 on error or at the end of the replay
+ */
+int readerWait(struct reader_t *r, uint64_t deadline);
+
+/*!
+ * \brief read whatever is available, like serialRead()
+ * \param r reader
+ * \param data buffer receiving the data
+ * \param length size of data
+ * \param deadline when to give up, see serialTime()
+ * \returns number of bytes read, 0 on timeout or signal,
+ * -1 on error or at the end of the replay
+ */
+int readerRead(struct reader_t *r, unsigned char *data, int length, uint64_t deadline);
+
+/*!
+ * \brief name of the way the port is read
+ * \param r reader
+ * \returns "poll", "spin", "io_uring" or "replay"
+ */
+const char *readerBackend(const struct reader_t *r);
+
+/*!
+ * \brief count the system calls made to wait for and read data
+ * \param r reader
+ * \returns system calls since readerOpen(), 0 while replaying
+ */
+unsigned long readerSyscalls(const struct reader_t *r);
+
+/*!
+ * \brief close the port or file, finishing the capture
+ * \param r reader
+ */
+void readerClose(struct reader_t *r);
+
+#endif
+
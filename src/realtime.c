@@ -0,0 +1,161 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE // pthread_setaffinity_np()
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "realtime.h"
+
+int realtimeParse(struct realtime_t *rt, const char *arg) {
+    memset(rt, 0, sizeof(struct realtime_t));
+    rt->priority = REALTIME_PRIORITY;
+
+    char *end;
+    long cpu = strtol(arg, &end, 10);
+    if ((end == arg) || (cpu < 0)) {
+        return -1;
+    }
+    rt->readerCpu = cpu;
+    rt->outputCpu = cpu;
+
+    if (*end == ',') {
+        const char *p = end + 1;
+        cpu = strtol(p, &end, 10);
+        if ((end == p) || (cpu < 0)) {
+            return -1;
+        }
+        rt->outputCpu = cpu;
+    }
+
+    if (*end == ':') {
+        const char *p = end + 1;
+        long priority = strtol(p, &end, 10);
+        if ((end == p) || (priority < sched_get_priority_min(SCHED_FIFO))
+                || (priority > sched_get_priority_max(SCHED_FIFO))) {
+            return -1;
+        }
+        rt->priority = priority;
+    }
+
+    return (*end == '\0') ? 0 : -1;
+}
+
+void realtimePrefault(void *buffer, size_t size) {
+    long page = sysconf(_SC_PAGESIZE);
+    volatile unsigned char *p = buffer;
+    for (size_t i = 0; i < size; i += page) {
+        p[i] = p[i];
+    }
+    if (size > 0) {
+        p[size - 1] = p[size - 1];
+    }
+}
+
+// Grow the stack now, the main loop never goes as deep
+static void realtimeStack(void) {
+    unsigned char stack[REALTIME_STACK];
+    realtimePrefault(stack, sizeof(stack));
+}
+
+int realtimeThread(const struct realtime_t *rt, pthread_t thread, int cpu) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = rt->priority;
+    int ret = pthread_setschedparam(thread, SCHED_FIFO, &param);
+    if (ret != 0) {
+        fprintf(stderr, "Couldn't switch to SCHED_FIFO: %s\n", strerror(ret));
+    }
+
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int pin = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    if (pin != 0) {
+        fprintf(stderr, "Couldn't pin thread to CPU %d: %s\n", cpu, strerror(pin));
+    }
+#else
+    // OS X only knows affinity hints between threads, not CPUs
+    int pin = 0;
+#endif
+
+    return ((ret == 0) && (pin == 0)) ? 0 : -1;
+}
+
+int realtimeStart(struct realtime_t *rt) {
+    int ret = 0;
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+        rt->locked = 1;
+    } else {
+        fprintf(stderr, "Couldn't lock memory: %s\n", strerror(errno));
+        ret = -1;
+    }
+
+#ifdef __GLIBC__
+    // Freed memory stays in the heap, so allocating it again never faults
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+
+    realtimeStack();
+
+    if (realtimeThread(rt, pthread_self(), rt->readerCpu) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+long realtimeHeap(void) {
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+void realtimeSteady(struct realtime_t *rt) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    rt->faults = usage.ru_minflt + usage.ru_majflt;
+    rt->majorFaults = usage.ru_majflt;
+    rt->heap = realtimeHeap();
+    rt->steady = 1;
+}
+
+void realtimePrint(const struct realtime_t *rt, FILE *out) {
+    fprintf(out, "Realtime: SCHED_FIFO %d, reader on CPU %d, output on CPU %d, memory %s\n",
+            rt->priority, rt->readerCpu, rt->outputCpu, rt->locked ? "locked" : "not locked");
+    if (!rt->steady) {
+        return;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long heap = realtimeHeap();
+    fprintf(out, "Steady state: %ld page faults (%ld major), ",
+            usage.ru_minflt + usage.ru_majflt - rt->faults, usage.ru_majflt - rt->majorFaults);
+    if ((heap >= 0) && (rt->heap >= 0)) {
+        fprintf(out, "heap grew by %ld bytes\n", heap - rt->heap);
+    } else {
+        fprintf(out, "heap usage unknown\n");
+    }
+}
+
@@ -0,0 +1,119 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _REALTIME_H_
+#define _REALTIME_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * Configuration
+ */
+
+#define REALTIME_PRIORITY 50 //!< Default SCHED_FIFO priority, below kernel interrupt threads
+#define REALTIME_STACK (256 * 1024) //!< Stack prefaulted by realtimeStart(), in bytes
+
+/*!
+ * \brief Frames after which the main loop is considered steady.
+ *
+ * Detecting the protocol and the first output still allocate and touch
+ * new memory, only faults and allocations after these are counted.
+ */
+#define REALTIME_WARMUP 64
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Scheduling settings, and faults and heap usage in the steady state.
+ */
+struct realtime_t {
+    int priority; //!< SCHED_FIFO priority of the pinned threads
+    int readerCpu; //!< CPU of the reading thread
+    int outputCpu; //!< CPU of the output thread
+
+    int locked; //!< all memory is locked
+    int steady; //!< realtimeSteady() has been called
+    long faults; //!< page faults of the process, at realtimeSteady()
+    long majorFaults; //!< page faults that needed I/O, at realtimeSteady()
+    long heap; //!< heap bytes in use by the process, at realtimeSteady()
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief set up real-time mode from its description
+ *
+ * The CPU of the reading thread, optionally followed by a comma and
+ * the CPU of the output thread, then optionally a colon and the
+ * SCHED_FIFO priority, eg. 2,3:60. Without a second CPU, both threads
+ * share the first one.
+ *
+ * \param rt settings to initialize
+ * \param arg description
+ * \returns 0 on success, -1 if it is invalid
+ */
+int realtimeParse(struct realtime_t *rt, const char *arg);
+
+/*!
+ * \brief lock memory and switch the calling thread to real-time
+ *
+ * Locks all current and future memory, so nothing is ever paged out,
+ * keeps the heap from shrinking, touches REALTIME_STACK bytes of the
+ * stack and switches the calling thread to SCHED_FIFO on readerCpu.
+ * Threads created afterwards get locked stacks. Failures are printed
+ * and the rest is done anyway, so it also works partially without
+ * privileges.
+ *
+ * \param rt settings
+ * \returns 0 if everything worked, -1 otherwise
+ */
+int realtimeStart(struct realtime_t *rt);
+
+/*!
+ * \brief switch another thread to SCHED_FIFO and pin it
+ * \param rt settings, for the priority
+ * \param thread thread to change
+ * \param cpu CPU to pin the thread to
+ * \returns 0 on success, -1 on error
+ */
+int realtimeThread(const struct realtime_t *rt, pthread_t thread, int cpu);
+
+/*!
+ * \brief touch every page of a buffer, so using it never faults
+ * \param buffer memory to touch
+ * \param size size of buffer
+ */
+void realtimePrefault(void *buffer, size_t size);
+
+/*!
+ * \brief heap memory in use by the process
+ * \returns bytes, or -1 if this C library can't tell
+ */
+long realtimeHeap(void);
+
+/*!
+ * \brief remember the page faults and heap usage so far, from here on nothing should be added
+ * \param rt settings and counters
+ */
+void realtimeSteady(struct realtime_t *rt);
+
+/*!
+ * \brief print the settings, and faults and heap growth since realtimeSteady()
+ * \param rt settings and counters
+ * \param out stream to print to
+ */
+void realtimePrint(const struct realtime_t *rt, FILE *out);
+
+#endif
+
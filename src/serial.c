@@ -7,6 +7,10 @@
  * ----------------------------------------------------------------------------
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE // ppoll()
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,9 +21,20 @@
 #include <errno.h>
 #include <time.h>
 #include <poll.h>
+#include <sys/uio.h>
+
+#ifdef __APPLE__
+#include <sys/ioctl.h>
+#include <mach/mach_time.h>
+#include <IOKit/serial/ioss.h>
+#endif
 
 #include "serial.h"
 
+#ifdef __linux__
+#include "serial_linux.h"
+#endif
+
 #ifndef XON
 #define XON 0x11
 #endif
@@ -32,47 +47,143 @@
 #define TIMEOUT 2
 #endif
 
-int serialOpen(const char *port, unsigned int baud) {
-    struct termios options;
+void serialDefaultConfig(struct serial_config_t *config, unsigned int baud) {
+    config->baud = baud;
+    config->dataBits = 8;
+    config->parity = 'N';
+    config->stopBits = 1;
+    config->lowLatency = 0;
+    config->vmin = 0; // Always return...
+    config->vtime = 0; // ..immediately from read()
+}
 
-    int fd = open(port, O_RDWR | O_NOCTTY | O_NDELAY);
-    if (fd == -1) {
-        fprintf(stderr, "Couldn't open port \"%s\": %s\n", port, strerror(errno));
+int serialParseFormat(struct serial_config_t *config, const char *format) {
+    if ((strlen(format) != 3)
+            || (format[0] < '5') || (format[0] > '8')
+            || (strchr("NEO", format[1]) == NULL)
+            || (format[2] < '1') || (format[2] > '2')) {
+        fprintf(stderr, "Invalid serial format \"%s\", expected eg. 8N1\n", format);
         return -1;
     }
 
-    tcgetattr(fd, &options);
+    config->dataBits = format[0] - '0';
+    config->parity = format[1];
+    config->stopBits = format[2] - '0';
+    return 0;
+}
 
-    options.c_lflag = 0;
-    options.c_oflag = 0;
-    options.c_iflag = 0;
+int serialParseOption(struct serial_config_t *config, int opt, const char *arg) {
+    char *end;
+    long value;
+
+    switch (opt) {
+        case 'b':
+            value = strtol(arg, &end, 10);
+            if ((*end != '\0') || (value <= 0)) {
+                fprintf(stderr, "Invalid baudrate \"%s\"\n", arg);
+                return -1;
+            }
+            config->baud = value;
+            return 1;
+        case 'f':
+            return (serialParseFormat(config, arg) == 0) ? 1 : -1;
+        case 'l':
+            config->lowLatency = 1;
+            return 1;
+        case 'm':
+        case 't':
+            value = strtol(arg, &end, 10);
+            if ((*end != '\0') || (value < 0) || (value > 255)) {
+                fprintf(stderr, "Invalid -%c value \"%s\"\n", opt, arg);
+                return -1;
+            }
+            if (opt == 'm') {
+                config->vmin = value;
+            } else {
+                config->vtime = value;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
 
-    // Set Baudrate
+static speed_t serialSpeed(unsigned int baud) {
     switch (baud) {
         case 9600:
-            cfsetispeed(&options, B9600);
-            cfsetospeed(&options, B9600);
-            break;
+            return B9600;
         case 19200:
-            cfsetispeed(&options, B19200);
-            cfsetospeed(&options, B19200);
-            break;
+            return B19200;
         case 38400:
-            cfsetispeed(&options, B38400);
-            cfsetospeed(&options, B38400);
-            break;
+            return B38400;
+#ifdef B76800
         case 76800:
-            cfsetispeed(&options, B76800);
-            cfsetospeed(&options, B76800);
-            break;
+            return B76800;
+#endif
+        case 57600:
+            return B57600;
         case 115200:
-            cfsetispeed(&options, B115200);
-            cfsetospeed(&options, B115200);
-            break;
+            return B115200;
+        case 230400:
+            return B230400;
         default:
-            fprintf(stderr, "Warning: Baudrate not supported!\n");
+            return 0;
+    }
+}
+
+int serialOpen(const char *port, unsigned int baud) {
+    struct serial_config_t config;
+    serialDefaultConfig(&config, baud);
+    return serialOpenConfig(port, &config);
+}
+
+int serialOpenConfig(const char *port, const struct serial_config_t *config) {
+    int fd = open(port, O_RDWR | O_NOCTTY | O_NDELAY);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open port \"%s\": %s\n", port, strerror(errno));
+        return -1;
+    }
+
+    if (serialConfigure(fd, config) != 0) {
+        serialClose(fd);
+        return -1;
+    }
+
+    // VMIN and VTIME only apply to blocking reads
+    if ((config->vmin > 0) || (config->vtime > 0)) {
+        int flags = fcntl(fd, F_GETFL);
+        if ((flags == -1) || (fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1)) {
+            fprintf(stderr, "Couldn't make port blocking: %s\n", strerror(errno));
             serialClose(fd);
             return -1;
+        }
+    }
+
+    return fd;
+}
+
+int serialConfigure(int fd, const struct serial_config_t *config) {
+    struct termios options;
+
+    tcgetattr(fd, &options);
+
+    options.c_lflag = 0;
+    options.c_oflag = 0;
+    options.c_iflag = 0;
+
+    // Set Baudrate. Other rates are set after tcsetattr().
+    speed_t speed = serialSpeed(config->baud);
+    if (speed != 0) {
+        cfsetispeed(&options, speed);
+        cfsetospeed(&options, speed);
+    } else {
+#if defined(__linux__) || defined(__APPLE__)
+        cfsetispeed(&options, B38400);
+        cfsetospeed(&options, B38400);
+#else
+        fprintf(stderr, "Warning: Baudrate not supported!\n");
+        return -1;
+#endif
     }
 
     // Input Modes
@@ -84,13 +195,36 @@ int serialOpen(const char *port, unsigned int baud) {
     options.c_oflag |= OPOST; // Post-process output
 
     // Control Modes
-    options.c_cflag |= CS8; // 8 data bits
+    options.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+    switch (config->dataBits) {
+        case 5:
+            options.c_cflag |= CS5;
+            break;
+        case 6:
+            options.c_cflag |= CS6;
+            break;
+        case 7:
+            options.c_cflag |= CS7;
+            break;
+        default:
+            options.c_cflag |= CS8;
+            break;
+    }
+    if (config->parity != 'N') {
+        options.c_cflag |= PARENB; // Generate and check parity...
+        if (config->parity == 'O') {
+            options.c_cflag |= PARODD; // ...odd instead of even
+        }
+    }
+    if (config->stopBits == 2) {
+        options.c_cflag |= CSTOPB;
+    }
     options.c_cflag |= CREAD; // Enable Receiver
     options.c_cflag |= CLOCAL; // Ignore modem status lines
 
     // Special characters
-    options.c_cc[VMIN] = 0; // Always return...
-    options.c_cc[VTIME] = 0; // ..immediately from read()
+    options.c_cc[VMIN] = config->vmin;
+    options.c_cc[VTIME] = config->vtime;
 #ifdef XONXOFF
     options.c_cc[VSTOP] = XOFF;
     options.c_cc[VSTART] = XON;
@@ -98,9 +232,35 @@ int serialOpen(const char *port, unsigned int baud) {
 
     tcsetattr(fd, TCSANOW, &options);
 
+    if (speed == 0) {
+#if defined(__linux__)
+        if (serialLinuxSetBaud(fd, config->baud) != 0) {
+            return -1;
+        }
+#elif defined(__APPLE__)
+        speed_t custom = config->baud;
+        if (ioctl(fd, IOSSIOSPEED, &custom) == -1) {
+            fprintf(stderr, "Couldn't set baudrate %u: %s\n", config->baud, strerror(errno));
+            return -1;
+        }
+#endif
+    }
+
+    if (config->lowLatency) {
+#if defined(__linux__)
+        // Not all drivers support this, so it is not fatal
+        serialLinuxLowLatency(fd);
+#elif defined(__APPLE__)
+        unsigned long latency = 1; // us
+        if (ioctl(fd, IOSSDATALAT, &latency) == -1) {
+            fprintf(stderr, "Couldn't set low latency mode: %s\n", strerror(errno));
+        }
+#endif
+    }
+
     tcflush(fd, TCIOFLUSH);
 
-    return fd;
+    return 0;
 }
 
 void serialClose(int fd) {
@@ -116,10 +276,11 @@ int serialHasChar(int fd, int timeout) {
     struct pollfd fds;
     fds.fd = fd;
     fds.events = (POLLIN | POLLPRI); // Data may be read
-    if (poll(&fds, 1, timeout) > 0) {
+    if ((poll(&fds, 1, timeout) > 0) && (fds.revents & fds.events)
+            && !(fds.revents & (POLLHUP | POLLERR | POLLNVAL))) {
         return 1;
     } else {
-        return 0;
+        return 0; // nothing ever arrives at a port that hung up
     }
 }
 
@@ -129,39 +290,263 @@ void serialWaitUntilSent(int fd) {
     }
 }
 
-unsigned int serialWriteRaw(int fd, const char *d, int len) {
-    unsigned int processed = 0;
-    time_t start = time(NULL);
+uint64_t serialTime(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+#endif
+}
 
-    while ((processed < len) && (difftime(time(NULL), start) < TIMEOUT)) {
-        int t = write(fd, (d + processed), (len - processed));
-        if (t == -1) {
-            fprintf(stderr, "Error while writing: %s\n", strerror(errno));
-            return processed;
-        } else {
+static int serialPoll(int fd, short events, uint64_t deadline) {
+    struct pollfd fds;
+    fds.fd = fd;
+    fds.events = events;
+
+    uint64_t now = serialTime();
+    uint64_t remaining = (deadline > now) ? (deadline - now) : 0;
+
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = remaining / 1000000;
+    ts.tv_nsec = (remaining % 1000000) * 1000;
+    int ret = ppoll(&fds, 1, &ts, NULL);
+#else
+    // Round up, poll() only knows milliseconds
+    int ret = poll(&fds, 1, (int)((remaining + 999) / 1000));
+#endif
+
+    if (ret == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        fprintf(stderr, "Error while polling: %s\n", strerror(errno));
+        return -1;
+    }
+    if (ret == 0) {
+        return 0;
+    }
+
+    // Data still waiting is taken first, only then the hangup is reported
+    if (fds.revents & events) {
+        return 1;
+    }
+    if (fds.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        fprintf(stderr, "Error while polling: port %s\n",
+                (fds.revents & POLLHUP) ? "hung up" : "is invalid");
+        return -1;
+    }
+    return 0;
+}
+
+// Without VMIN and VTIME a terminal returns 0 instead of EAGAIN, so a read()
+// of nothing is only the end of the file if the port also hung up
+static int serialHungUp(int fd) {
+    struct pollfd fds;
+    fds.fd = fd;
+    fds.events = POLLIN | POLLPRI;
+    if ((poll(&fds, 1, 0) > 0) && (fds.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+        fprintf(stderr, "Error while reading: end of file\n");
+        return 1;
+    }
+    return 0;
+}
+
+int serialWait(int fd, uint64_t deadline) {
+    return serialPoll(fd, POLLIN | POLLPRI, deadline);
+}
+
+int serialRead(int fd, char *data, int length, uint64_t deadline) {
+    unsigned long syscalls = 0;
+    return serialReadCount(fd, data, length, deadline, &syscalls);
+}
+
+int serialReadCount(int fd, char *data, int length, uint64_t deadline, unsigned long *syscalls) {
+    int waited = 0;
+    for (;;) {
+        // Try first, most of the time data is already waiting
+        ssize_t t = read(fd, data, length);
+        (*syscalls)++;
+        if (t > 0) {
+            return t;
+        } else if (t == 0) {
+            if (waited && serialHungUp(fd)) {
+                return -1;
+            }
+        } else if ((errno != EAGAIN) && (errno != EINTR)) {
+            fprintf(stderr, "Error while reading: %s\n", strerror(errno));
+            return -1;
+        }
+
+        if (serialTime() >= deadline) {
+            return 0;
+        }
+        int ret = serialWait(fd, deadline);
+        (*syscalls)++;
+        if (ret != 1) {
+            return ret;
+        }
+        waited = 1;
+    }
+}
+
+// Tell the CPU that this is a busy polling loop
+static void serialRelax(int pause) {
+    if (!pause) {
+        return;
+    }
+    for (int i = 0; i < SERIAL_SPINPAUSES; i++) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+}
+
+int serialSpinRead(int fd, char *data, int length, uint64_t deadline, unsigned int spin,
+        int pause, unsigned long *syscalls) {
+    uint64_t end = serialTime() + spin;
+    if (end > deadline) {
+        end = deadline;
+    }
+
+    do {
+        ssize_t t = read(fd, data, length);
+        (*syscalls)++;
+        if (t > 0) {
+            return t;
+        } else if ((t == -1) && (errno != EAGAIN) && (errno != EINTR)) {
+            fprintf(stderr, "Error while reading: %s\n", strerror(errno));
+            return -1;
+        }
+        serialRelax(pause);
+    } while (serialTime() < end);
+
+    // Nothing arrived while spinning, sleep until something does
+    return serialReadCount(fd, data, length, deadline, syscalls);
+}
+
+int serialSpinWait(int fd, uint64_t deadline, unsigned int spin, int pause,
+        unsigned long *syscalls) {
+    uint64_t end = serialTime() + spin;
+    if (end > deadline) {
+        end = deadline;
+    }
+
+    do {
+        // A deadline in the past only checks, without sleeping
+        int ret = serialPoll(fd, POLLIN | POLLPRI, 0);
+        (*syscalls)++;
+        if (ret != 0) {
+            return ret;
+        }
+        serialRelax(pause);
+    } while (serialTime() < end);
+
+    (*syscalls)++;
+    return serialWait(fd, deadline);
+}
+
+int serialWrite(int fd, const char *data, int length, uint64_t deadline) {
+    int processed = 0;
+
+    while (processed < length) {
+        ssize_t t = write(fd, data + processed, length - processed);
+        if (t > 0) {
             processed += t;
+            continue;
+        } else if ((t == -1) && (errno != EAGAIN) && (errno != EINTR)) {
+            fprintf(stderr, "Error while writing: %s\n", strerror(errno));
+            return (processed > 0) ? processed : -1;
         }
 
-        usleep(1000);
+        if (serialTime() >= deadline) {
+            return processed;
+        }
+        int ret = serialPoll(fd, POLLOUT, deadline);
+        if (ret != 1) {
+            return (processed > 0) ? processed : ret;
+        }
     }
 
     return processed;
 }
 
+void serialRingInit(struct serial_ring_t *r, unsigned char *buffer, unsigned int size) {
+    r->buffer = buffer;
+    r->size = size;
+    r->head = 0;
+    r->tail = 0;
+}
+
+int serialReadRing(int fd, struct serial_ring_t *r, uint64_t deadline) {
+    unsigned int space = r->size - (r->head - r->tail);
+    if (space == 0) {
+        return 0;
+    }
+
+    // The free space wraps around at most once
+    unsigned int start = r->head & (r->size - 1);
+    unsigned int first = r->size - start;
+    if (first > space) {
+        first = space;
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = r->buffer + start;
+    iov[0].iov_len = first;
+    iov[1].iov_base = r->buffer;
+    iov[1].iov_len = space - first;
+
+    int waited = 0;
+    for (;;) {
+        ssize_t t = readv(fd, iov, (iov[1].iov_len > 0) ? 2 : 1);
+        if (t > 0) {
+            r->head += t;
+            return t;
+        } else if (t == 0) {
+            if (waited && serialHungUp(fd)) {
+                return -1;
+            }
+        } else if ((errno != EAGAIN) && (errno != EINTR)) {
+            fprintf(stderr, "Error while reading: %s\n", strerror(errno));
+            return -1;
+        }
+
+        if (serialTime() >= deadline) {
+            return 0;
+        }
+        int ret = serialWait(fd, deadline);
+        if (ret != 1) {
+            return ret;
+        }
+        waited = 1;
+    }
+}
+
+unsigned int serialWriteRaw(int fd, const char *d, int len) {
+    int ret = serialWrite(fd, d, len, serialTime() + (TIMEOUT * 1000000ULL));
+    return (ret > 0) ? ret : 0;
+}
+
 unsigned int serialReadRaw(int fd, char *d, int len) {
     unsigned int processed = 0;
-    time_t start = time(NULL);
+    uint64_t deadline = serialTime() + (TIMEOUT * 1000000ULL);
 
-    while ((processed < len) && (difftime(time(NULL), start) < TIMEOUT)) {
-        int t = read(fd, (d + processed), (len - processed));
-        if (t == -1) {
-            fprintf(stderr, "Error while reading: %s\n", strerror(errno));
-            return processed;
-        } else {
+    while (processed < len) {
+        int t = serialRead(fd, d + processed, len - processed, deadline);
+        if (t > 0) {
             processed += t;
+        } else if ((t == -1) || (serialTime() >= deadline)) {
+            break;
         }
-
-        usleep(1000);
     }
 
     return processed;
@@ -10,6 +10,8 @@
 #ifndef _SERIAL_H_
 #define _SERIAL_H_
 
+#include <stdint.h>
+
 /*
  * Configuration
  */
@@ -54,10 +56,72 @@
  */
 #define TIMEOUT 2
 
+/*!
+ * \brief Pause instructions between two reads of a busy polling loop.
+ *
+ * They tell the CPU that it is spinning, which saves power and leaves
+ * the core to the other hardware thread, if there is one, at the cost
+ * of noticing data a little later.
+ */
+#define SERIAL_SPINPAUSES 16
+
 /*
  * Setup
  */
 
+/*!
+ * \brief Line settings used by serialOpenConfig().
+ */
+struct serial_config_t {
+    unsigned int baud; //!< any rate, non-standard ones need Linux or OS X
+    int dataBits; //!< 5 to 8
+    char parity; //!< 'N'one, 'E'ven or 'O'dd
+    int stopBits; //!< 1 or 2
+    int lowLatency; //!< ask the driver to pass on data immediately
+    int vmin; //!< termios VMIN, bytes read() waits for, makes the port blocking
+    int vtime; //!< termios VTIME, in tenths of a second, makes the port blocking
+};
+
+/*!
+ * \brief fill in the default 8N1 settings
+ * \param config settings to initialize
+ * \param baud baudrate
+ */
+void serialDefaultConfig(struct serial_config_t *config, unsigned int baud);
+
+/*!
+ * \brief parse a format like "8N1" or "8E2"
+ * \param config settings to modify
+ * \param format data bits, parity and stop bits
+ * \returns 0 on success, -1 if format is invalid
+ */
+int serialParseFormat(struct serial_config_t *config, const char *format);
+
+/*!
+ * \brief getopt() option string for the line settings.
+ */
+#define SERIAL_OPTIONS "b:f:lm:t:"
+
+/*!
+ * \brief Usage text describing SERIAL_OPTIONS.
+ */
+#define SERIAL_USAGE \
+    "\t-b <baud>   baudrate, any value on Linux and OS X\n" \
+    "\t-f <format> data bits, parity and stop bits, eg. 8N1 or 8E2\n" \
+    "\t-l         low latency mode\n" \
+    "\t-m <vmin>   termios VMIN, makes read() block\n" \
+    "\t-t <vtime>  termios VTIME, in tenths of a second, makes read() block\n"
+
+/*!
+ * \brief apply one of the SERIAL_OPTIONS returned by getopt()
+ * \param config settings to modify
+ * \param opt option character
+ * \param arg option argument
+ * \returns 1 if opt has been handled, 0 if it is no serial option,
+ * -1 if the argument is invalid
+ */
+int serialParseOption(struct serial_config_t *config, int opt, const char *arg);
+
 /*!
  * \brief open a serial port
  * \param port name of port
@@ -66,6 +130,27 @@
  */
 int serialOpen(const char *port, unsigned int baud);
 
+/*!
+ * \brief open a serial port with the given line settings
+ *
+ * The port is non-blocking, unless VMIN or VTIME are set. The kernel
+ * ignores both for non-blocking reads, so then read() blocks as they
+ * describe, and deadlines and signals are only noticed when it returns.
+ *
+ * \param port name of port
+ * \param config line settings
+ * \returns file handle or -1 on error
+ */
+int serialOpenConfig(const char *port, const struct serial_config_t *config);
+
+/*!
+ * \brief change the line settings of an open serial port
+ * \param fd file handle of port to configure
+ * \param config line settings
+ * \returns 0 on success, -1 on error
+ */
+int serialConfigure(int fd, const struct serial_config_t *config);
+
 /*!
  * \brief close an open serial port
  * \param fd file handle of port to close
@@ -108,6 +193,122 @@ unsigned int serialWriteRaw(int fd, const char *data, int length);
  */
 void serialWaitUntilSent(int fd);
 
+/*
+ * Deadline based I/O
+ *
+ * Deadlines are absolute points in time on the monotonic clock,
+ * in microseconds, as returned by serialTime(). These functions
+ * wait in poll() and return as soon as anything has been done.
+ * A port that hung up, eg. an unplugged adapter or a closed pseudo
+ * terminal, is an error, once the data still waiting has been read.
+ */
+
+/*!
+ * \brief Ring buffer that can be filled directly by serialReadRing().
+ *
+ * head and tail are free running, size has to be a power of two.
+ */
+struct serial_ring_t {
+    unsigned char *buffer; //!< caller supplied storage
+    unsigned int size; //!< size of buffer
+    unsigned int head; //!< total bytes written
+    unsigned int tail; //!< total bytes consumed
+};
+
+/*!
+ * \brief get the current time
+ * \returns monotonic clock in microseconds
+ */
+uint64_t serialTime(void);
+
+/*!
+ * \brief wait until data can be read
+ * \param fd file handle of port to wait for
+ * \param deadline when to give up, see serialTime()
+ * \returns 1 if data is available, 0 on timeout or signal, -1 on error
+ */
+int serialWait(int fd, uint64_t deadline);
+
+/*!
+ * \brief read whatever is available, waiting for at least one byte
+ * \param fd file handle of port to read from
+ * \param data buffer receiving the data
+ * \param length size of data
+ * \param deadline when to give up, see serialTime()
+ * \returns number of bytes read, 0 on timeout or signal, -1 on error
+ */
+int serialRead(int fd, char *data, int length, uint64_t deadline);
+
+/*!
+ * \brief serialRead(), also counting the system calls made
+ * \param fd file handle of port to read from
+ * \param data buffer receiving the data
+ * \param length size of data
+ * \param deadline when to give up, see serialTime()
+ * \param syscalls incremented for every read() and poll()
+ * \returns number of bytes read, 0 on timeout or signal, -1 on error
+ */
+int serialReadCount(int fd, char *data, int length, uint64_t deadline, unsigned long *syscalls);
+
+/*!
+ * \brief serialReadCount(), but busy polling with read() before waiting in poll()
+ *
+ * Calls read() over and over for up to spin microseconds, so data is
+ * taken as soon as the driver has it, without waking up a sleeping
+ * thread. Only then it falls back to poll(). This keeps a CPU busy.
+ *
+ * \param fd file handle of port to read from
+ * \param data buffer receiving the data
+ * \param length size of data
+ * \param deadline when to give up, see serialTime()
+ * \param spin microseconds to spin before waiting in poll()
+ * \param pause execute SERIAL_SPINPAUSES pause instructions between two read() calls
+ * \param syscalls incremented for every read() and poll()
+ * \returns number of bytes read, 0 on timeout or signal, -1 on error
+ */
+int serialSpinRead(int fd, char *data, int length, uint64_t deadline, unsigned int spin,
+        int pause, unsigned long *syscalls);
+
+/*!
+ * \brief serialWait(), but busy polling without timeout before waiting
+ * \param fd file handle of port to wait for
+ * \param deadline when to give up, see serialTime()
+ * \param spin microseconds to spin before waiting in poll()
+ * \param pause execute SERIAL_SPINPAUSES pause instructions between two poll() calls
+ * \param syscalls incremented for every poll()
+ * \returns 1 if data is available, 0 on timeout or signal, -1 on error
+ */
+int serialSpinWait(int fd, uint64_t deadline, unsigned int spin, int pause,
+        unsigned long *syscalls);
+
+/*!
+ * \brief write data, waiting for the port to accept it
+ * \param fd file handle of port to write to
+ * \param data buffer containing data to write
+ * \param length number of bytes to write
+ * \param deadline when to give up, see serialTime()
+ * \returns number of bytes written, may be less than length
+ * on timeout or signal, -1 on error
+ */
+int serialWrite(int fd, const char *data, int length, uint64_t deadline);
+
+/*!
+ * \brief prepare a ring buffer
+ * \param r ring buffer to initialize
+ * \param buffer storage to use
+ * \param size size of buffer, has to be a power of two
+ */
+void serialRingInit(struct serial_ring_t *r, unsigned char *buffer, unsigned int size);
+
+/*!
+ * \brief read whatever is available into the free space of a ring buffer
+ * \param fd file handle of port to read from
+ * \param r ring buffer to fill, head is advanced
+ * \param deadline when to give up, see serialTime()
+ * \returns number of bytes read, 0 on timeout, signal or full ring, -1 on error
+ */
+int serialReadRing(int fd, struct serial_ring_t *r, uint64_t deadline);
+
 /*
  * Blocking I/O
  */
@@ -0,0 +1,57 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
+
+#include "serial_linux.h"
+
+int serialLinuxSetBaud(int fd, unsigned int baud) {
+    struct termios2 options;
+
+    if (ioctl(fd, TCGETS2, &options) == -1) {
+        fprintf(stderr, "Couldn't get termios2: %s\n", strerror(errno));
+        return -1;
+    }
+
+    options.c_cflag &= ~CBAUD;
+    options.c_cflag |= BOTHER;
+    options.c_ispeed = baud;
+    options.c_ospeed = baud;
+
+    if (ioctl(fd, TCSETS2, &options) == -1) {
+        fprintf(stderr, "Couldn't set baudrate %u: %s\n", baud, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int serialLinuxLowLatency(int fd) {
+    struct serial_struct serial;
+
+    if (ioctl(fd, TIOCGSERIAL, &serial) == -1) {
+        fprintf(stderr, "Couldn't get serial settings: %s\n", strerror(errno));
+        return -1;
+    }
+
+    serial.flags |= ASYNC_LOW_LATENCY;
+
+    if (ioctl(fd, TIOCSSERIAL, &serial) == -1) {
+        fprintf(stderr, "Couldn't set low latency mode: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
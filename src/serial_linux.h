@@ -0,0 +1,34 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _SERIAL_LINUX_H_
+#define _SERIAL_LINUX_H_
+
+/*
+ * Linux specific port settings. These live in their own file because
+ * the kernel termios2 definitions clash with the ones in <termios.h>.
+ */
+
+/*!
+ * \brief set an arbitrary baudrate using termios2 and BOTHER
+ * \param fd file handle of an open port
+ * \param baud baudrate
+ * \returns 0 on success, -1 on error
+ */
+int serialLinuxSetBaud(int fd, unsigned int baud);
+
+/*!
+ * \brief set the ASYNC_LOW_LATENCY flag of a serial port
+ * \param fd file handle of an open port
+ * \returns 0 on success, -1 on error
+ */
+int serialLinuxLowLatency(int fd);
+
+#endif
+
@@ -0,0 +1,228 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sink.h"
+
+#define DEBUGINTERVAL 50000000 // ns between two debug outputs
+
+static int nullOpen(struct sink_t *sink) {
+    return 0;
+}
+
+static int nullSend(struct sink_t *sink, const struct sink_report_t *report) {
+    return 0;
+}
+
+static void nullClose(struct sink_t *sink) { }
+
+struct sink_t sinkNull = { "null", nullOpen, nullSend, nullClose };
+
+static int debugOpen(struct sink_t *sink) {
+    printf("Debug mode, no driver\n");
+    return 0;
+}
+
+static int debugSend(struct sink_t *sink, const struct sink_report_t *report) {
+    static const char *names[SINK_AXES] = {
+        "Left X", "Left Y", "Right X", "Right Y", "Aux 1", "Aux 2", "Aux 3", "Aux 4"
+    };
+
+    // At up to 1kHz frame rate, printing each frame costs far more than decoding it
+    uint64_t now = latencyNow();
+    if ((now - sink->lastPrint) >= DEBUGINTERVAL) {
+        sink->lastPrint = now;
+        if (sink->index > 0) {
+            printf("%d: ", sink->index);
+        }
+        for (int i = 0; i < SINK_AXES; i++) {
+            if (sink->layout.axes & (1U << i)) {
+                printf("%s: %4d ", names[i], report->axes[i]);
+            }
+        }
+        if (sink->layout.buttons > 0) {
+            printf("Buttons: ");
+            for (int i = 0; i < sink->layout.buttons; i++) {
+                putchar((report->buttons & (1UL << i)) ? '1' : '0');
+            }
+        }
+        printf("\n");
+        sink->syscalls++;
+    }
+    return 0;
+}
+
+struct sink_t sinkDebug = { "debug", debugOpen, debugSend, nullClose };
+
+// The first entry is the default
+static struct sink_t *sinks[] = {
+#ifdef __APPLE__
+    &sinkFoohid,
+#endif
+#ifdef __linux__
+    &sinkUinput,
+#endif
+    &sinkDebug,
+    &sinkNull,
+};
+
+#define SINK_COUNT (sizeof(sinks) / sizeof(sinks[0]))
+
+struct sink_t *sinkFind(const char *name) {
+    if (name == NULL) {
+        return sinks[0];
+    }
+
+    for (size_t i = 0; i < SINK_COUNT; i++) {
+        if (strcmp(sinks[i]->name, name) == 0) {
+            return sinks[i];
+        }
+    }
+    return NULL;
+}
+
+const char *sinkNames(void) {
+    static char names[64] = "";
+    if (names[0] == '\0') {
+        for (size_t i = 0; i < SINK_COUNT; i++) {
+            if (i > 0) {
+                strncat(names, " ", sizeof(names) - strlen(names) - 1);
+            }
+            strncat(names, sinks[i]->name, sizeof(names) - strlen(names) - 1);
+        }
+    }
+    return names;
+}
+
+void sinkInstance(struct sink_t *sink, const struct sink_t *backend, int index) {
+    *sink = *backend;
+    sink->index = index;
+}
+
+int sinkSuppress(struct sink_t *sink, const char *deadband, unsigned int keepAlive) {
+    int count = 0;
+    const char *p = deadband;
+    while ((count < SINK_AXES) && (*p != '\0')) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if ((end == p) || (value < 0) || ((*end != ',') && (*end != '\0'))) {
+            return -1;
+        }
+        sink->deadband[count++] = value;
+        p = (*end == ',') ? (end + 1) : end;
+    }
+
+    if ((*p != '\0') || (count == 0)) {
+        return -1;
+    }
+    for (int i = count; i < SINK_AXES; i++) {
+        sink->deadband[i] = sink->deadband[count - 1];
+    }
+
+    sink->keepAlive = keepAlive * 1000000ULL;
+    sink->suppress = 1;
+    return 0;
+}
+
+int sinkOpen(struct sink_t *sink, const struct sink_layout_t *layout) {
+    sink->layout = *layout;
+    if (sink->index > 0) {
+        snprintf(sink->device, sizeof(sink->device), "%s %d", VIRTUAL_DEVICE_NAME, sink->index);
+        snprintf(sink->serial, sizeof(sink->serial), "%s-%d", VIRTUAL_DEVICE_SERIAL, sink->index);
+    } else {
+        snprintf(sink->device, sizeof(sink->device), "%s", VIRTUAL_DEVICE_NAME);
+        snprintf(sink->serial, sizeof(sink->serial), "%s", VIRTUAL_DEVICE_SERIAL);
+    }
+    sink->handle = -1;
+    sink->lastPrint = 0;
+    sink->reports = 0;
+    sink->suppressed = 0;
+    sink->errors = 0;
+    sink->syscalls = 0;
+    memset(&sink->latency, 0, sizeof(sink->latency));
+    memset(&sink->jitter, 0, sizeof(sink->jitter));
+    sink->lastSent = 0;
+    sink->interval = 0;
+    return sink->open(sink);
+}
+
+// Check if no button changed and no axis moved further than its deadband
+// since the last report sent
+static int sinkUnchanged(const struct sink_t *sink, const struct sink_report_t *report) {
+    uint32_t buttons = (sink->layout.buttons < 32) ? ((1UL << sink->layout.buttons) - 1) : ~0UL;
+    if ((report->buttons ^ sink->last.buttons) & buttons) {
+        return 0;
+    }
+    for (int i = 0; i < SINK_AXES; i++) {
+        if ((sink->layout.axes & (1U << i))
+                && (abs(report->axes[i] - sink->last.axes[i]) > sink->deadband[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int sinkSend(struct sink_t *sink, const struct sink_report_t *report) {
+    uint64_t start = latencyNow();
+    sink->reports++;
+
+    if (sink->suppress && (sink->lastSent != 0) && ((start - sink->lastSent) < sink->keepAlive)
+            && sinkUnchanged(sink, report)) {
+        sink->suppressed++;
+        return 0;
+    }
+
+    int ret = sink->send(sink, report);
+    if (ret != 0) {
+        // The device still has the previous state, so don't suppress against this one
+        sink->errors++;
+        return ret;
+    }
+    latencyAdd(&sink->latency, latencyNow() - start);
+
+    // Jitter as the difference between consecutive intervals (RFC 3393),
+    // independent of the frame rate and of slow drift
+    if (sink->lastSent != 0) {
+        uint64_t interval = start - sink->lastSent;
+        if (sink->interval != 0) {
+            latencyAdd(&sink->jitter, (interval > sink->interval) ? (interval - sink->interval)
+                    : (sink->interval - interval));
+        }
+        sink->interval = interval;
+    }
+
+    sink->last = *report;
+    sink->lastSent = start;
+    return 0;
+}
+
+void sinkClose(struct sink_t *sink) {
+    sink->close(sink);
+}
+
+void sinkPrint(const struct sink_t *sink, FILE *out) {
+    fprintf(out, "Sink %s: %lu reports, %lu suppressed (%.1f%%), %lu errors, %.2f syscalls per report\n",
+            sink->name, sink->reports, sink->suppressed,
+            (sink->reports > 0) ? (100.0 * sink->suppressed / sink->reports) : 0.0, sink->errors,
+            (sink->reports > 0) ? ((double)sink->syscalls / sink->reports) : 0.0);
+    fprintf(out, "Send latency: p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+            latencyPercentile(&sink->latency, 50.0) / 1000.0,
+            latencyPercentile(&sink->latency, 99.0) / 1000.0,
+            latencyPercentile(&sink->latency, 99.9) / 1000.0,
+            sink->latency.max / 1000.0);
+    fprintf(out, "Send jitter: p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+            latencyPercentile(&sink->jitter, 50.0) / 1000.0,
+            latencyPercentile(&sink->jitter, 99.0) / 1000.0,
+            latencyPercentile(&sink->jitter, 99.9) / 1000.0,
+            sink->jitter.max / 1000.0);
+}
+
@@ -0,0 +1,209 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "latency.h"
+
+/*
+ * Configuration
+ */
+
+#define SINK_AXES 8 //!< Maximum number of axes of the virtual gamepad
+#define SINK_BUTTONS 32 //!< Maximum number of buttons of the virtual gamepad
+#define SINK_AXISMAXIMUM 511 //!< Axis values go from -SINK_AXISMAXIMUM to SINK_AXISMAXIMUM
+
+#define VIRTUAL_DEVICE_NAME "Virtual Serial Transmitter" //!< Name of the created device
+#define VIRTUAL_DEVICE_SERIAL "SN 123456" //!< Serial number of the created device
+#define SINK_NAMELENGTH 48 //!< Size of the device name and serial number, including the terminator
+
+/*!
+ * \brief Default time after which an unchanged report is sent again, in ms.
+ */
+#define SINK_KEEPALIVE 100
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Axes of the virtual gamepad.
+ */
+enum sink_axis_t {
+    SINK_LEFTX = 0,
+    SINK_LEFTY,
+    SINK_RIGHTX,
+    SINK_RIGHTY,
+    SINK_AUX1,
+    SINK_AUX2,
+    SINK_AUX3,
+    SINK_AUX4
+};
+
+/*!
+ * \brief State of the virtual gamepad, sent once per frame.
+ */
+struct sink_report_t {
+    int16_t axes[SINK_AXES]; //!< indexed by sink_axis_t
+    uint32_t buttons; //!< bit n is button n + 1
+};
+
+/*!
+ * \brief Axes and buttons the virtual gamepad has.
+ *
+ * Values in a sink_report_t that are not part of the layout are ignored.
+ */
+struct sink_layout_t {
+    unsigned int axes; //!< bit n is set if axis n is used
+    int buttons; //!< buttons 1 to this are used
+};
+
+/*!
+ * \brief An output backend, and the one device it creates.
+ *
+ * The backends listed below are templates. Using one directly creates
+ * a single device. For more devices, each one gets its own copy from
+ * sinkInstance(). Backends keep all state of a device in here.
+ */
+struct sink_t {
+    const char *name;
+
+    // Create the device with the layout, returns 0 on success, -1 on error
+    int (*open)(struct sink_t *sink);
+
+    // Hand one report to the device, returns 0 on success, -1 on error
+    int (*send)(struct sink_t *sink, const struct sink_report_t *report);
+
+    // Destroy the device
+    void (*close)(struct sink_t *sink);
+
+    struct sink_layout_t layout; //!< set by sinkOpen()
+    int index; //!< device number, 0 if there is only one, see sinkInstance()
+    char device[SINK_NAMELENGTH]; //!< name of the device, set by sinkOpen()
+    char serial[SINK_NAMELENGTH]; //!< serial number of the device, set by sinkOpen()
+    int handle; //!< file descriptor or connection of the backend, -1 if none
+    uint64_t lastPrint; //!< time of the last output of the debug backend
+
+    int suppress; //!< skip reports without changes, see sinkSuppress()
+    int deadband[SINK_AXES]; //!< changes up to this are ignored
+    uint64_t keepAlive; //!< ns after which a report is sent anyway
+
+    unsigned long reports; //!< reports passed to sinkSend()
+    unsigned long suppressed; //!< reports not sent, nothing changed
+    unsigned long errors; //!< reports send failed for
+    unsigned long syscalls; //!< system calls made by send
+    struct latency_histogram_t latency; //!< time spent in send
+    struct latency_histogram_t jitter; //!< change of the time between two sends
+
+    struct sink_report_t last; //!< last report really sent
+    uint64_t lastSent; //!< latencyNow() when it was sent
+    uint64_t interval; //!< time between the last two sends
+};
+
+/*
+ * Backends
+ */
+
+extern struct sink_t sinkNull; //!< only counts reports
+extern struct sink_t sinkDebug; //!< prints reports, at most 20 times per second
+
+#ifdef __APPLE__
+extern struct sink_t sinkFoohid; //!< foohid virtual HID device, OS X only
+#endif
+
+#ifdef __linux__
+extern struct sink_t sinkUinput; //!< uinput virtual joystick, Linux only
+#endif
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief find a backend
+ * \param name backend name, or NULL for the default of this platform
+ * \returns backend, or NULL if there is none with this name
+ */
+struct sink_t *sinkFind(const char *name);
+
+/*!
+ * \brief list the names of all backends
+ * \returns static string, names separated by spaces
+ */
+const char *sinkNames(void);
+
+/*!
+ * \brief copy a backend to create one of several devices
+ *
+ * The copy keeps the settings of the backend, eg. from sinkSuppress().
+ * Device n is named VIRTUAL_DEVICE_NAME followed by n, and its serial
+ * number is VIRTUAL_DEVICE_SERIAL followed by -n, so games can tell
+ * the devices apart and keep their settings for each one.
+ *
+ * \param sink receives the copy, opened with sinkOpen() as usual
+ * \param backend template returned by sinkFind()
+ * \param index device number, starting at 1
+ */
+void sinkInstance(struct sink_t *sink, const struct sink_t *backend, int index);
+
+/*!
+ * \brief only send reports that differ from the last one sent
+ *
+ * A report is skipped if no button changed and no axis moved more than
+ * its deadband away from the last report really sent, so slow movements
+ * still add up. Still, a report is sent at least every keepAlive ms.
+ *
+ * \param sink backend
+ * \param deadband values separated by commas, in axis units, for the
+ * axes in the order of sink_axis_t. The last value is used for all
+ * remaining axes. 0 only skips identical reports.
+ * \param keepAlive maximum time between two reports in ms
+ * \returns 0 on success, -1 if deadband is invalid
+ */
+int sinkSuppress(struct sink_t *sink, const char *deadband, unsigned int keepAlive);
+
+/*!
+ * \brief create the device of a backend
+ *
+ * The device gets VIRTUAL_DEVICE_NAME and VIRTUAL_DEVICE_SERIAL,
+ * unless it was numbered by sinkInstance().
+ *
+ * \param sink backend
+ * \param layout axes and buttons of the device
+ * \returns 0 on success, -1 on error
+ */
+int sinkOpen(struct sink_t *sink, const struct sink_layout_t *layout);
+
+/*!
+ * \brief send a report, unless suppressed, measuring the time it takes
+ * \param sink backend
+ * \param report axis values to send
+ * \returns 0 on success, -1 on error
+ */
+int sinkSend(struct sink_t *sink, const struct sink_report_t *report);
+
+/*!
+ * \brief destroy the device of a backend
+ * \param sink backend
+ */
+void sinkClose(struct sink_t *sink);
+
+/*!
+ * \brief print reports, suppression ratio, system calls per report, send latency and jitter
+ * \param sink backend
+ * \param out stream to print to
+ */
+void sinkPrint(const struct sink_t *sink, FILE *out);
+
+#endif
+
@@ -0,0 +1,123 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <IOKit/IOKitLib.h>
+
+#include "sink.h"
+#include "hidreport.h"
+
+#define FOOHID_NAME "it_unbit_foohid"
+#define FOOHID_CREATE 0
+#define FOOHID_DESTROY 1
+#define FOOHID_SEND 2
+#define FOOHID_LIST 3
+#define input_count 8
+
+// Each device has its own connection, kept in the handle of the sink
+static int foohidOpen(struct sink_t *sink) {
+    printf("Searching for foohid Kernel extension...\n");
+
+    // get a reference to the IOService
+    io_iterator_t iterator;
+    io_service_t service;
+    io_connect_t connect;
+    kern_return_t ret = IOServiceGetMatchingServices(kIOMasterPortDefault,
+                            IOServiceMatching(FOOHID_NAME), &iterator);
+    if (ret != KERN_SUCCESS) {
+        printf("Unable to access foohid IOService\n");
+        return -1;
+    }
+
+    int found = 0;
+    while ((service = IOIteratorNext(iterator)) != IO_OBJECT_NULL) {
+        ret = IOServiceOpen(service, mach_task_self(), 0, &connect);
+        if (ret == KERN_SUCCESS) {
+            found = 1;
+            break;
+        }
+    }
+    IOObjectRelease(iterator);
+    if (!found) {
+        printf("Unable to open foohid IOService\n");
+        return -1;
+    }
+
+    printf("Creating virtual HID device %s...\n", sink->device);
+
+    // Created from the layout, see hidreport.h
+    uint8_t report_descriptor[HID_DESCRIPTOR_MAX];
+    int length = hidDescriptor(&sink->layout, report_descriptor);
+
+    uint64_t input[input_count];
+    input[0] = (uint64_t)sink->device;
+    input[1] = strlen(sink->device);
+
+    input[2] = (uint64_t)report_descriptor;
+    input[3] = length;
+
+    input[4] = (uint64_t)sink->serial;
+    input[5] = strlen(sink->serial);
+
+    input[6] = (uint64_t)2; // vendor ID
+    input[7] = (uint64_t)3; // device ID
+
+    ret = IOConnectCallScalarMethod(connect, FOOHID_CREATE, input, input_count, NULL, 0);
+    if (ret != KERN_SUCCESS) {
+        printf("Unable to create virtual HID device\n");
+        IOServiceClose(connect);
+        return -1;
+    }
+
+    sink->handle = (int)connect;
+    return 0;
+}
+
+static int foohidSend(struct sink_t *sink, const struct sink_report_t *report) {
+    uint8_t data[HID_REPORT_MAX];
+    uint64_t input[4];
+    input[0] = (uint64_t)sink->device;
+    input[1] = strlen(sink->device);
+    input[2] = (uint64_t)data;
+    input[3] = hidPack(&sink->layout, report, data);
+    kern_return_t ret = IOConnectCallScalarMethod((io_connect_t)sink->handle, FOOHID_SEND,
+            input, 4, NULL, 0);
+    sink->syscalls++;
+    if (ret != KERN_SUCCESS) {
+        fprintf(stderr, "Unable to send packet to virtual HID device\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void foohidClose(struct sink_t *sink) {
+    printf("Destroying virtual HID device %s\n", sink->device);
+
+    if (sink->handle == -1) {
+        return;
+    }
+
+    uint64_t input[2];
+    input[0] = (uint64_t)sink->device;
+    input[1] = strlen(sink->device);
+    kern_return_t ret = IOConnectCallScalarMethod((io_connect_t)sink->handle, FOOHID_DESTROY,
+            input, 2, NULL, 0);
+    if (ret != KERN_SUCCESS) {
+        printf("Unable to destroy virtual HID device\n");
+    }
+    IOServiceClose((io_connect_t)sink->handle);
+    sink->handle = -1;
+}
+
+struct sink_t sinkFoohid = { "foohid", foohidOpen, foohidSend, foohidClose };
+
@@ -0,0 +1,128 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "sink.h"
+
+#define UINPUT_PATH "/dev/uinput"
+#define UINPUT_VENDOR 2 // same IDs as the foohid device
+#define UINPUT_PRODUCT 3
+
+// Event codes of the axes, in the order of sink_axis_t
+static const int axisCodes[SINK_AXES] = {
+    ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_THROTTLE, ABS_RUDDER
+};
+
+// Event code of button i + 1, there are 40 of these codes
+#define BUTTONCODE(i) (BTN_TRIGGER_HAPPY1 + (i))
+
+static int uinputOpen(struct sink_t *sink) {
+    printf("Creating uinput device %s...\n", sink->device);
+
+    int fd = open(UINPUT_PATH, O_WRONLY | O_NONBLOCK);
+    if (fd == -1) {
+        fprintf(stderr, "Couldn't open %s: %s\n", UINPUT_PATH, strerror(errno));
+        return -1;
+    }
+
+    struct uinput_user_dev dev;
+    memset(&dev, 0, sizeof(dev));
+    snprintf(dev.name, sizeof(dev.name), "%s", sink->device);
+    dev.id.bustype = BUS_VIRTUAL;
+    dev.id.vendor = UINPUT_VENDOR;
+    dev.id.product = UINPUT_PRODUCT;
+    dev.id.version = 1;
+
+    // uinput has no serial number, the physical path tells the devices apart
+    int ret = ioctl(fd, UI_SET_PHYS, sink->serial);
+    if (ret != -1) {
+        ret = ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    }
+    for (int i = 0; (i < SINK_AXES) && (ret != -1); i++) {
+        if (sink->layout.axes & (1U << i)) {
+            ret = ioctl(fd, UI_SET_ABSBIT, axisCodes[i]);
+            dev.absmin[axisCodes[i]] = -SINK_AXISMAXIMUM;
+            dev.absmax[axisCodes[i]] = SINK_AXISMAXIMUM;
+        }
+    }
+    if ((ret != -1) && (sink->layout.buttons > 0)) {
+        ret = ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    }
+    for (int i = 0; (i < sink->layout.buttons) && (ret != -1); i++) {
+        ret = ioctl(fd, UI_SET_KEYBIT, BUTTONCODE(i));
+    }
+
+    if ((ret == -1) || (write(fd, &dev, sizeof(dev)) != sizeof(dev))
+            || (ioctl(fd, UI_DEV_CREATE) == -1)) {
+        fprintf(stderr, "Couldn't create uinput device: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    sink->handle = fd;
+    return 0;
+}
+
+static int uinputSend(struct sink_t *sink, const struct sink_report_t *report) {
+    // All axes, buttons and the report boundary in a single system call.
+    // The kernel drops values that did not change on its own.
+    struct input_event events[SINK_AXES + SINK_BUTTONS + 1];
+    memset(events, 0, sizeof(events));
+
+    int count = 0;
+    for (int i = 0; i < SINK_AXES; i++) {
+        if (sink->layout.axes & (1U << i)) {
+            events[count].type = EV_ABS;
+            events[count].code = axisCodes[i];
+            events[count].value = report->axes[i];
+            count++;
+        }
+    }
+    for (int i = 0; i < sink->layout.buttons; i++) {
+        events[count].type = EV_KEY;
+        events[count].code = BUTTONCODE(i);
+        events[count].value = (report->buttons >> i) & 1;
+        count++;
+    }
+    events[count].type = EV_SYN;
+    events[count].code = SYN_REPORT;
+    count++;
+
+    ssize_t size = count * sizeof(struct input_event);
+    ssize_t ret = write(sink->handle, events, size);
+    sink->syscalls++;
+    if (ret != size) {
+        fprintf(stderr, "Unable to send events to uinput device: %s\n",
+                (ret == -1) ? strerror(errno) : "short write");
+        return -1;
+    }
+    return 0;
+}
+
+static void uinputClose(struct sink_t *sink) {
+    printf("Destroying uinput device %s\n", sink->device);
+
+    if (sink->handle != -1) {
+        ioctl(sink->handle, UI_DEV_DESTROY);
+        close(sink->handle);
+        sink->handle = -1;
+    }
+}
+
+struct sink_t sinkUinput = { "uinput", uinputOpen, uinputSend, uinputClose };
+
@@ -0,0 +1,84 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "stamp.h"
+
+#define STAMP_MASK ((1 << STAMP_BITS) - 1)
+#define SEQUENCE_MASK ((1UL << STAMP_SEQUENCEBITS) - 1)
+#define TIME_MASK ((1ULL << STAMP_TIMEBITS) - 1)
+
+void stampWrite(struct decoder_frame_t *frame, uint32_t sequence, uint64_t time) {
+    uint64_t bits = ((uint64_t)(sequence & SEQUENCE_MASK) << STAMP_TIMEBITS) | (time & TIME_MASK);
+
+    for (int i = STAMP_CHANNELS - 1; i >= 0; i--) {
+        frame->channels[i] = STAMP_BASE + (bits & STAMP_MASK);
+        bits >>= STAMP_BITS;
+    }
+
+    if (frame->count < STAMP_CHANNELS) {
+        frame->count = STAMP_CHANNELS;
+    }
+}
+
+int stampRead(const struct decoder_frame_t *frame, uint32_t *sequence, uint64_t *time) {
+    if (frame->count < STAMP_CHANNELS) {
+        return -1;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < STAMP_CHANNELS; i++) {
+        int value = frame->channels[i] - STAMP_BASE;
+        if ((value < 0) || (value > STAMP_MASK)) {
+            return -1;
+        }
+        bits = (bits << STAMP_BITS) | value;
+    }
+
+    *sequence = bits >> STAMP_TIMEBITS;
+    *time = bits & TIME_MASK;
+    return 0;
+}
+
+void stampInit(struct stamp_stats_t *s) {
+    memset(s, 0, sizeof(struct stamp_stats_t));
+}
+
+void stampRecord(struct stamp_stats_t *s, uint32_t sequence, uint64_t time, uint64_t now) {
+    if (s->frames > 0) {
+        uint32_t gap = (sequence - s->sequence - 1) & SEQUENCE_MASK;
+        if (gap < (SEQUENCE_MASK / 2)) {
+            s->lost += gap;
+            s->sequence = sequence;
+        } else {
+            // Duplicate or reordered, the missing frame has been counted as lost
+            s->late++;
+        }
+    } else {
+        s->sequence = sequence;
+    }
+    s->frames++;
+
+    // Only the lower bits of the time are known, the difference still fits
+    uint64_t elapsed = (now - time) & TIME_MASK;
+    latencyAdd(&s->latency, elapsed * 1000);
+}
+
+void stampPrint(const struct stamp_stats_t *s, FILE *out) {
+    unsigned long total = s->frames + s->lost;
+    fprintf(out, "End-to-end: %lu frames, %lu lost (%.3f%%), %lu late\n", s->frames, s->lost,
+            (total > 0) ? (100.0 * s->lost / total) : 0.0, s->late);
+    fprintf(out, "Latency: p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+            latencyPercentile(&s->latency, 50.0) / 1000.0,
+            latencyPercentile(&s->latency, 99.0) / 1000.0,
+            latencyPercentile(&s->latency, 99.9) / 1000.0,
+            s->latency.max / 1000.0);
+}
+
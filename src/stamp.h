@@ -0,0 +1,96 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _STAMP_H_
+#define _STAMP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "decoder.h"
+#include "latency.h"
+
+/*
+ * Configuration
+ *
+ * A stamp hides a sequence number and the time a frame was sent in
+ * the first STAMP_CHANNELS channels, STAMP_BITS in each, offset by
+ * STAMP_BASE. This survives the decoding and scaling of all protocols.
+ */
+
+#define STAMP_CHANNELS 6 //!< channels used, every protocol has at least 6
+#define STAMP_BITS 10 //!< bits stored in each channel
+#define STAMP_BASE 1000 //!< value of a channel storing 0
+#define STAMP_SEQUENCEBITS 20 //!< bits of the sequence number, in the first 2 channels
+#define STAMP_TIMEBITS 40 //!< bits of the send time, in the remaining 4 channels
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief Frame loss and latency of received stamps.
+ */
+struct stamp_stats_t {
+    unsigned long frames; //!< stamped frames received
+    unsigned long lost; //!< gaps in the sequence numbers
+    unsigned long late; //!< frames older than the newest one received
+    uint32_t sequence; //!< last sequence number received
+    struct latency_histogram_t latency; //!< send time until stampRecord()
+};
+
+/*
+ * Stamping
+ */
+
+/*!
+ * \brief store a sequence number and time in a frame
+ * \param frame frame to modify, count is set to at least STAMP_CHANNELS
+ * \param sequence frame number, only the lower STAMP_SEQUENCEBITS are stored
+ * \param time serialTime() when the frame is sent, only the lower STAMP_TIMEBITS are stored
+ */
+void stampWrite(struct decoder_frame_t *frame, uint32_t sequence, uint64_t time);
+
+/*!
+ * \brief get the sequence number and time from a decoded frame
+ * \param frame decoded frame
+ * \param sequence receives the sequence number
+ * \param time receives the lower STAMP_TIMEBITS of the send time
+ * \returns 0 on success, -1 if the frame contains no stamp
+ */
+int stampRead(const struct decoder_frame_t *frame, uint32_t *sequence, uint64_t *time);
+
+/*
+ * Evaluation
+ */
+
+/*!
+ * \brief reset the statistics
+ * \param s statistics to clear
+ */
+void stampInit(struct stamp_stats_t *s);
+
+/*!
+ * \brief account for a received stamp
+ * \param s statistics
+ * \param sequence as returned by stampRead()
+ * \param time as returned by stampRead()
+ * \param now serialTime() when the frame has been handled
+ */
+void stampRecord(struct stamp_stats_t *s, uint32_t sequence, uint64_t time, uint64_t now);
+
+/*!
+ * \brief print frame loss and end-to-end latency
+ * \param s statistics
+ * \param out stream to print to
+ */
+void stampPrint(const struct stamp_stats_t *s, FILE *out);
+
+#endif
+
@@ -0,0 +1,279 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transfer.h"
+
+#define LINELENGTH 256
+
+#define DEFAULTAXES 6 // leftx to aux2
+#define SWITCHFIRST 6 // first channel turned into buttons
+#define SWITCHCHANNELS (IBUS_CHANNELS - SWITCHFIRST)
+
+// Profile names of the axes, in the order of sink_axis_t
+static const char *axisNames[SINK_AXES] = {
+    "leftx", "lefty", "rightx", "righty", "aux1", "aux2", "aux3", "aux4"
+};
+
+// Source channels of the axes, in the order of sink_axis_t
+static const int defaultChannels[SINK_AXES] = { 3, 2, 0, 1, 4, 5, 6, 7 };
+
+void transferInit(struct transfer_t *t, enum decoder_protocol_t protocol) {
+    // CT6B values go from 1000 - 2022, the others are centered on 1500
+    int center = (protocol == PROTOCOL_CT6B) ? (1000 + SINK_AXISMAXIMUM) : 1500;
+
+    for (int i = 0; i < SINK_AXES; i++) {
+        struct transfer_axis_t *a = &t->axes[i];
+        a->enabled = (i < DEFAULTAXES);
+        a->channel = defaultChannels[i];
+        a->minimum = center - SINK_AXISMAXIMUM;
+        a->center = center;
+        a->maximum = center + SINK_AXISMAXIMUM;
+        a->deadzone = 0;
+        a->expo = 0;
+        a->rate = 100;
+        a->reverse = 0;
+    }
+
+    // Low and high position of each switch
+    for (int i = 0; i < SINK_BUTTONS; i++) {
+        struct transfer_button_t *b = &t->buttons[i];
+        b->enabled = (i < (2 * SWITCHCHANNELS));
+        b->channel = SWITCHFIRST + (i / 2);
+        b->low = ((i % 2) == 0);
+        b->threshold = b->low ? (center - TRANSFER_SWITCH) : (center + TRANSFER_SWITCH);
+    }
+}
+
+// Set one key of an axis, returns -1 for unknown keys
+static int transferSet(struct transfer_axis_t *a, const char *key, const char *value) {
+    if ((strcmp(key, "off") == 0) && (value == NULL)) {
+        a->enabled = 0;
+        return 0;
+    }
+    if (strcmp(key, "reverse") == 0) {
+        a->reverse = (value == NULL) ? 1 : (atoi(value) != 0);
+        return 0;
+    }
+    if (value == NULL) {
+        return -1;
+    }
+
+    char *end;
+    long number = strtol(value, &end, 10);
+    if ((end == value) || (*end != '\0')) {
+        return -1;
+    }
+
+    if (strcmp(key, "channel") == 0) {
+        a->channel = number - 1;
+    } else if (strcmp(key, "min") == 0) {
+        a->minimum = number;
+    } else if (strcmp(key, "center") == 0) {
+        a->center = number;
+    } else if (strcmp(key, "max") == 0) {
+        a->maximum = number;
+    } else if (strcmp(key, "deadzone") == 0) {
+        a->deadzone = number;
+    } else if (strcmp(key, "expo") == 0) {
+        a->expo = number;
+    } else if (strcmp(key, "rate") == 0) {
+        a->rate = number;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Set one key of a button, returns -1 for unknown keys
+static int transferSetButton(struct transfer_button_t *b, const char *key, const char *value) {
+    if ((strcmp(key, "off") == 0) && (value == NULL)) {
+        b->enabled = 0;
+        return 0;
+    }
+    if (strcmp(key, "low") == 0) {
+        b->low = (value == NULL) ? 1 : (atoi(value) != 0);
+        return 0;
+    }
+    if (value == NULL) {
+        return -1;
+    }
+
+    char *end;
+    long number = strtol(value, &end, 10);
+    if ((end == value) || (*end != '\0')) {
+        return -1;
+    }
+
+    if (strcmp(key, "channel") == 0) {
+        b->channel = number - 1;
+    } else if (strcmp(key, "threshold") == 0) {
+        b->threshold = number;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static const char *transferCheck(const struct transfer_axis_t *a) {
+    if ((a->channel < 0) || (a->channel >= DECODER_MAX_CHANNELS)) {
+        return "channel out of range";
+    }
+    if ((a->minimum >= a->center) || (a->center >= a->maximum)) {
+        return "min, center and max must be ascending";
+    }
+    if ((a->deadzone < 0) || (a->deadzone >= (a->center - a->minimum))
+            || (a->deadzone >= (a->maximum - a->center))) {
+        return "deadzone must be smaller than both halves";
+    }
+    if ((a->expo < 0) || (a->expo > 100)) {
+        return "expo must be 0 - 100";
+    }
+    if (a->rate < 0) {
+        return "rate must not be negative";
+    }
+    return NULL;
+}
+
+int transferLoad(struct transfer_t *t, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror("Couldn't open profile");
+        return -1;
+    }
+
+    char line[LINELENGTH];
+    int number = 0;
+    int ret = 0;
+    while ((ret == 0) && (fgets(line, sizeof(line), fp) != NULL)) {
+        number++;
+
+        char *token = strtok(line, " \t\r\n");
+        if ((token == NULL) || (token[0] == '#')) {
+            continue;
+        }
+
+        struct transfer_axis_t *a = NULL;
+        struct transfer_button_t *b = NULL;
+        for (int i = 0; i < SINK_AXES; i++) {
+            if (strcmp(token, axisNames[i]) == 0) {
+                a = &t->axes[i];
+            }
+        }
+        char *end;
+        if (strncmp(token, "button", 6) == 0) {
+            long button = strtol(token + 6, &end, 10);
+            if ((end != (token + 6)) && (*end == '\0') && (button >= 1) && (button <= SINK_BUTTONS)) {
+                b = &t->buttons[button - 1];
+            }
+        }
+        if ((a == NULL) && (b == NULL)) {
+            fprintf(stderr, "%s:%d: unknown axis or button %s\n", path, number, token);
+            ret = -1;
+            break;
+        }
+        if (a != NULL) {
+            a->enabled = 1;
+        } else {
+            b->enabled = 1;
+        }
+
+        while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+            char *value = strchr(token, '=');
+            if (value != NULL) {
+                *value++ = '\0';
+            }
+            if (((a != NULL) ? transferSet(a, token, value) : transferSetButton(b, token, value)) != 0) {
+                fprintf(stderr, "%s:%d: invalid setting %s\n", path, number, token);
+                ret = -1;
+                break;
+            }
+        }
+
+        const char *error = NULL;
+        if (a != NULL) {
+            error = transferCheck(a);
+        } else if ((b->channel < 0) || (b->channel >= DECODER_MAX_CHANNELS)) {
+            error = "channel out of range";
+        }
+        if ((ret == 0) && (error != NULL)) {
+            fprintf(stderr, "%s:%d: %s\n", path, number, error);
+            ret = -1;
+        }
+    }
+
+    fclose(fp);
+    return ret;
+}
+
+int16_t transferCompute(const struct transfer_axis_t *a, int value) {
+    // Each half is calibrated on its own, the center is not always in the middle
+    int range = (value >= a->center) ? (a->maximum - a->center) : (a->center - a->minimum);
+    int offset = value - a->center;
+    int magnitude = (offset < 0) ? -offset : offset;
+
+    if (magnitude <= a->deadzone) {
+        return 0;
+    }
+
+    // Start moving right at the edge of the deadzone, not with a jump
+    double x = (double)(magnitude - a->deadzone) / (range - a->deadzone);
+    if (x > 1.0) {
+        x = 1.0;
+    }
+
+    double expo = a->expo / 100.0;
+    x = ((1.0 - expo) * x) + (expo * x * x * x);
+
+    x *= a->rate / 100.0;
+    if (x > 1.0) {
+        x = 1.0;
+    }
+
+    int result = (int)((x * SINK_AXISMAXIMUM) + 0.5);
+    if ((offset < 0) != (a->reverse != 0)) {
+        result = -result;
+    }
+    return result;
+}
+
+void transferBuild(struct transfer_t *t) {
+    for (int i = 0; i < SINK_AXES; i++) {
+        for (int v = 0; v < TRANSFER_VALUES; v++) {
+            t->tables[i][v] = transferCompute(&t->axes[i], TRANSFER_LOWEST + v);
+        }
+    }
+
+    // Buttons after the last one turned on are never checked
+    t->buttonCount = 0;
+    for (int i = 0; i < SINK_BUTTONS; i++) {
+        if (t->buttons[i].enabled) {
+            t->buttonCount = i + 1;
+        }
+    }
+}
+
+void transferLayout(const struct transfer_t *t, struct sink_layout_t *layout) {
+    layout->axes = 0;
+    for (int i = 0; i < SINK_AXES; i++) {
+        if (t->axes[i].enabled) {
+            layout->axes |= 1U << i;
+        }
+    }
+
+    layout->buttons = 0;
+    for (int i = 0; i < SINK_BUTTONS; i++) {
+        if (t->buttons[i].enabled) {
+            layout->buttons = i + 1;
+        }
+    }
+}
@@ -0,0 +1,183 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _TRANSFER_H_
+#define _TRANSFER_H_
+
+#include <stdint.h>
+
+#include "decoder.h"
+#include "sink.h"
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Smallest channel value with its own table entry.
+ *
+ * The tables cover every value any decoder returns for a working
+ * receiver, 880 - 2159 for SBUS and CRSF. Values outside are clamped.
+ */
+#define TRANSFER_LOWEST 768
+
+#define TRANSFER_VALUES 1536 //!< Entries in the table of each axis
+
+/*!
+ * \brief Distance from the center at which switches count as moved.
+ */
+#define TRANSFER_SWITCH (SINK_AXISMAXIMUM / 2)
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief How a channel is turned into a gamepad axis.
+ */
+struct transfer_axis_t {
+    int enabled; //!< part of the gamepad
+    int channel; //!< source channel, starting at 0
+    int minimum; //!< channel value for full negative deflection
+    int center; //!< channel value for the center
+    int maximum; //!< channel value for full positive deflection
+    int deadzone; //!< channel values around the center mapped to the center
+    int expo; //!< 0 is linear, 100 is cubic, in percent
+    int rate; //!< scales the result, 100 uses the full range, in percent
+    int reverse; //!< swap both directions
+};
+
+/*!
+ * \brief How a channel is turned into a gamepad button.
+ */
+struct transfer_button_t {
+    int enabled; //!< part of the gamepad
+    int channel; //!< source channel, starting at 0
+    int threshold; //!< channel value at which the button changes
+    int low; //!< pressed below the threshold instead of above
+};
+
+/*!
+ * \brief Settings and lookup tables of all axes and buttons.
+ *
+ * Everything is computed once in transferBuild(), so processing a
+ * frame is a single table lookup per axis and a comparison per button.
+ */
+struct transfer_t {
+    struct transfer_axis_t axes[SINK_AXES];
+    struct transfer_button_t buttons[SINK_BUTTONS];
+    int buttonCount; //!< highest enabled button, see transferBuild()
+    int16_t tables[SINK_AXES][TRANSFER_VALUES];
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief set the default mapping and calibration of a protocol
+ *
+ * The defaults map the channels exactly like before there were
+ * profiles: channel 4, 3, 1, 2, 5, 6 to left X, left Y, right X,
+ * right Y, aux 1 and aux 2, linear, 1 per channel value. Aux 3 and 4
+ * are off. The remaining iBus channels 7 - 14 are usually switches,
+ * each of them becomes two buttons, one pressed in the low and one in
+ * the high position, so two and three position switches both work.
+ *
+ * \param t settings to initialize
+ * \param protocol the values of CT6B are offset from the others
+ */
+void transferInit(struct transfer_t *t, enum decoder_protocol_t protocol);
+
+/*!
+ * \brief change settings from a profile file
+ *
+ * Each line names an axis (leftx, lefty, rightx, righty, aux1 - aux4),
+ * followed by any of channel=, min=, center=, max=, deadzone=, expo=,
+ * rate= and reverse, or a button (button1 - button32), followed by any
+ * of channel=, threshold= and low. Naming an axis or button turns it
+ * on, unless off is given. Channels start at 1. Everything not
+ * mentioned keeps its value. Empty lines and lines starting with # are
+ * ignored. Errors are printed to stderr.
+ *
+ * \param t settings to change
+ * \param path profile file
+ * \returns 0 on success, -1 on error
+ */
+int transferLoad(struct transfer_t *t, const char *path);
+
+/*!
+ * \brief compute the lookup tables from the settings
+ * \param t settings and tables
+ */
+void transferBuild(struct transfer_t *t);
+
+/*!
+ * \brief axes and buttons that are turned on
+ * \param t settings
+ * \param layout filled with the gamepad layout
+ */
+void transferLayout(const struct transfer_t *t, struct sink_layout_t *layout);
+
+/*!
+ * \brief compute a single axis value without the lookup table
+ * \param a settings of the axis
+ * \param value channel value
+ * \returns axis value, -SINK_AXISMAXIMUM to SINK_AXISMAXIMUM
+ */
+int16_t transferCompute(const struct transfer_axis_t *a, int value);
+
+/*!
+ * \brief compute the buttons of a decoded frame
+ * \param t settings, see transferBuild()
+ * \param frame decoded channel values
+ * \returns bit n set if button n + 1 is pressed
+ */
+static inline uint32_t transferButtons(const struct transfer_t *t, const struct decoder_frame_t *frame) {
+    uint32_t buttons = 0;
+    for (int i = 0; i < t->buttonCount; i++) {
+        const struct transfer_button_t *b = &t->buttons[i];
+        if (b->enabled && (b->channel < frame->count)) {
+            int value = frame->channels[b->channel];
+            if (b->low ? (value < b->threshold) : (value > b->threshold)) {
+                buttons |= 1UL << i;
+            }
+        }
+    }
+    return buttons;
+}
+
+/*!
+ * \brief fill a report from a decoded frame
+ *
+ * Axes whose channel is missing from the frame are centered,
+ * buttons whose channel is missing are released.
+ *
+ * \param t settings and tables, see transferBuild()
+ * \param frame decoded channel values
+ * \param report filled with the axis values
+ */
+static inline void transferApply(const struct transfer_t *t, const struct decoder_frame_t *frame,
+        struct sink_report_t *report) {
+    for (int i = 0; i < SINK_AXES; i++) {
+        int channel = t->axes[i].channel;
+        int value = (channel < frame->count) ? frame->channels[channel] : t->axes[i].center;
+        value -= TRANSFER_LOWEST;
+        if (value < 0) {
+            value = 0;
+        } else if (value >= TRANSFER_VALUES) {
+            value = TRANSFER_VALUES - 1;
+        }
+        report->axes[i] = t->tables[i][value];
+    }
+    report->buttons = transferButtons(t, frame);
+}
+
+#endif
+
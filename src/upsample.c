@@ -0,0 +1,143 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "upsample.h"
+
+#define PERIODSHIFT 3 // a new interval weighs 1/8 in the average
+
+static const char *modeNames[UPSAMPLE_MODES] = {
+    [UPSAMPLE_HOLD] = "hold",
+    [UPSAMPLE_INTERPOLATE] = "interpolate",
+    [UPSAMPLE_EXTRAPOLATE] = "extrapolate",
+};
+
+const char *upsampleName(enum upsample_mode_t mode) {
+    if ((mode < 0) || (mode >= UPSAMPLE_MODES)) {
+        return "unknown";
+    }
+    return modeNames[mode];
+}
+
+int upsampleParse(struct upsample_t *u, const char *mode) {
+    memset(u, 0, sizeof(struct upsample_t));
+
+    size_t length = strcspn(mode, "=");
+    for (int i = 0; i < UPSAMPLE_MODES; i++) {
+        if ((strlen(modeNames[i]) == length) && (strncmp(mode, modeNames[i], length) == 0)) {
+            u->mode = i;
+            if (mode[length] == '\0') {
+                return 0;
+            }
+            if (i != UPSAMPLE_EXTRAPOLATE) {
+                return -1;
+            }
+
+            char *end;
+            long lead = strtol(mode + length + 1, &end, 10);
+            if ((end == (mode + length + 1)) || (*end != '\0') || (lead < 0)) {
+                return -1;
+            }
+            u->lead = lead * 1000000ULL;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int difference(int a, int b) {
+    return (a > b) ? (a - b) : (b - a);
+}
+
+void upsampleFeed(struct upsample_t *u, const struct mailbox_entry_t *entry, unsigned int count) {
+    if (u->frames == 0) {
+        u->previous = entry->frame;
+        count = 1;
+    } else {
+        // Frames decoded from a single read arrive at the same time, they don't count
+        if (entry->time > u->time) {
+            uint64_t interval = (entry->time - u->time) / count;
+            if (u->period == 0) {
+                u->period = interval;
+            } else {
+                u->period = u->period - (u->period >> PERIODSHIFT) + (interval >> PERIODSHIFT);
+            }
+        }
+
+        // What was sent when the frame arrived, compared to what it contains
+        struct decoder_frame_t predicted;
+        upsampleAt(u, entry->time, &predicted);
+        for (int i = 0; i < entry->frame.count; i++) {
+            latencyAdd(&u->error, difference(predicted.channels[i], entry->frame.channels[i]));
+            latencyAdd(&u->holdError, difference(u->latest.channels[i], entry->frame.channels[i]));
+        }
+
+        u->previous = u->latest;
+    }
+
+    u->latest = entry->frame;
+    u->time = entry->time;
+    u->gap = count;
+    u->frames++;
+}
+
+void upsampleAt(const struct upsample_t *u, uint64_t time, struct decoder_frame_t *frame) {
+    *frame = u->latest;
+    if ((u->mode == UPSAMPLE_HOLD) || (u->frames < 2) || (u->period == 0)) {
+        return;
+    }
+
+    uint64_t since = (time > u->time) ? (time - u->time) : 0;
+
+    if (u->mode == UPSAMPLE_INTERPOLATE) {
+        // Arrives at the latest frame when the next one is due
+        double x = (since < u->period) ? ((double)since / u->period) : 1.0;
+        for (int i = 0; i < frame->count; i++) {
+            double value = u->previous.channels[i]
+                    + ((u->latest.channels[i] - u->previous.channels[i]) * x);
+            frame->channels[i] = (uint16_t)(value + 0.5);
+        }
+        return;
+    }
+
+    // Never further than a single frame, in case the next one is lost
+    uint64_t ahead = ((since < u->period) ? since : u->period) + u->lead;
+    double span = (double)u->period * u->gap;
+    for (int i = 0; i < frame->count; i++) {
+        double speed = (u->latest.channels[i] - u->previous.channels[i]) * 1e9 / span;
+        if (speed > UPSAMPLE_MAXSPEED) {
+            speed = UPSAMPLE_MAXSPEED;
+        } else if (speed < -UPSAMPLE_MAXSPEED) {
+            speed = -UPSAMPLE_MAXSPEED;
+        }
+
+        double value = u->latest.channels[i] + (speed * ahead / 1e9);
+        if (value < 0.0) {
+            value = 0.0;
+        } else if (value > UINT16_MAX) {
+            value = UINT16_MAX;
+        }
+        frame->channels[i] = (uint16_t)(value + 0.5);
+    }
+}
+
+void upsamplePrint(const struct upsample_t *u, FILE *out) {
+    fprintf(out, "Upsampling: %s, %lu frames, every %.2fms\n", upsampleName(u->mode), u->frames,
+            u->period / 1e6);
+    fprintf(out, "Prediction error: p50 %llu p99 %llu max %llu, holding p50 %llu p99 %llu max %llu\n",
+            (unsigned long long)latencyPercentile(&u->error, 50.0),
+            (unsigned long long)latencyPercentile(&u->error, 99.0),
+            (unsigned long long)u->error.max,
+            (unsigned long long)latencyPercentile(&u->holdError, 50.0),
+            (unsigned long long)latencyPercentile(&u->holdError, 99.0),
+            (unsigned long long)u->holdError.max);
+}
+
@@ -0,0 +1,116 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _UPSAMPLE_H_
+#define _UPSAMPLE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "decoder.h"
+#include "latency.h"
+#include "mailbox.h"
+
+/*
+ * Configuration
+ */
+
+/*!
+ * \brief Fastest change of a channel that is extrapolated, in values per second.
+ *
+ * A stick moved across its whole range in a tenth of a second. Anything
+ * faster is most likely a switch or a glitch, not worth following.
+ */
+#define UPSAMPLE_MAXSPEED 10000
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief How reports between two frames are created.
+ */
+enum upsample_mode_t {
+    UPSAMPLE_HOLD = 0, //!< repeat the latest frame
+    UPSAMPLE_INTERPOLATE, //!< move from the previous to the latest frame, one frame late
+    UPSAMPLE_EXTRAPOLATE, //!< continue the movement of the last two frames
+
+    UPSAMPLE_MODES
+};
+
+/*!
+ * \brief Last two frames and the prediction error.
+ */
+struct upsample_t {
+    enum upsample_mode_t mode;
+    uint64_t lead; //!< ns extrapolated beyond the current time
+
+    struct decoder_frame_t previous; //!< frame before the latest
+    struct decoder_frame_t latest; //!< latest frame
+    uint64_t time; //!< arrival of the latest frame
+    unsigned int gap; //!< frames from previous to latest, more than 1 if some were replaced
+    uint64_t period; //!< average ns between two frames, 0 until known
+    unsigned long frames; //!< frames received
+
+    struct latency_histogram_t error; //!< channel difference between output and new frames
+    struct latency_histogram_t holdError; //!< the same without upsampling, for comparison
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief set up upsampling from its name
+ *
+ * interpolate, or extrapolate, optionally followed by =<ms>
+ * to look this far into the future, to hide transmission delay.
+ *
+ * \param u upsampling state to initialize
+ * \param mode name of the mode
+ * \returns 0 on success, -1 if the name is invalid
+ */
+int upsampleParse(struct upsample_t *u, const char *mode);
+
+/*!
+ * \brief name of a mode
+ * \param mode upsampling mode
+ * \returns name used by upsampleParse()
+ */
+const char *upsampleName(enum upsample_mode_t mode);
+
+/*!
+ * \brief add a new frame
+ *
+ * Before it is stored, the frame is compared with what upsampleAt()
+ * returns for its arrival time, to measure the prediction error.
+ *
+ * \param u upsampling state
+ * \param entry new frame and its arrival time
+ * \param count frames received since the last call, including this one
+ */
+void upsampleFeed(struct upsample_t *u, const struct mailbox_entry_t *entry, unsigned int count);
+
+/*!
+ * \brief create a frame for any time after the latest frame
+ * \param u upsampling state
+ * \param time latencyNow() the frame is sent
+ * \param frame filled with the channel values
+ */
+void upsampleAt(const struct upsample_t *u, uint64_t time, struct decoder_frame_t *frame);
+
+/*!
+ * \brief print the frame interval and the prediction error
+ * \param u upsampling state
+ * \param out stream to print to
+ */
+void upsamplePrint(const struct upsample_t *u, FILE *out);
+
+#endif
+
@@ -0,0 +1,239 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "serial.h"
+#include "uring.h"
+
+// Marks the completion of the read, there is only ever one in flight
+#define READTAG 1
+
+static int uringSetup(unsigned int entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uringEnter(struct uring_t *u, unsigned int submit, unsigned int complete,
+        unsigned int flags, void *arg, size_t size) {
+    u->syscalls++;
+    return (int)syscall(__NR_io_uring_enter, u->ring, submit, complete, flags, arg, size);
+}
+
+static int uringRegister(int ring, unsigned int opcode, void *arg, unsigned int count) {
+    return (int)syscall(__NR_io_uring_register, ring, opcode, arg, count);
+}
+
+static void uringUnmap(struct uring_t *u) {
+    if ((u->sqes != NULL) && (u->sqes != MAP_FAILED)) {
+        munmap(u->sqes, u->sqesSize);
+    }
+    if ((u->cqRing != NULL) && (u->cqRing != MAP_FAILED) && (u->cqRing != u->sqRing)) {
+        munmap(u->cqRing, u->cqSize);
+    }
+    if ((u->sqRing != NULL) && (u->sqRing != MAP_FAILED)) {
+        munmap(u->sqRing, u->sqSize);
+    }
+}
+
+int uringOpen(struct uring_t *u, int fd) {
+    memset(u, 0, offsetof(struct uring_t, buffer));
+    u->fd = fd;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    u->ring = uringSetup(URING_ENTRIES, &p);
+    if (u->ring == -1) {
+        fprintf(stderr, "Couldn't set up io_uring: %s\n", strerror(errno));
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        fprintf(stderr, "io_uring of this kernel can't wait with a timeout\n");
+        close(u->ring);
+        u->ring = -1;
+        return -1;
+    }
+
+    // Newer kernels map both rings at once
+    u->sqSize = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+    u->cqSize = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cqSize > u->sqSize) {
+            u->sqSize = u->cqSize;
+        }
+        u->cqSize = u->sqSize;
+    }
+    u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    u->sqRing = mmap(NULL, u->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            u->ring, IORING_OFF_SQ_RING);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cqRing = u->sqRing;
+    } else {
+        u->cqRing = mmap(NULL, u->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                u->ring, IORING_OFF_CQ_RING);
+    }
+    u->sqes = mmap(NULL, u->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            u->ring, IORING_OFF_SQES);
+    if ((u->sqRing == MAP_FAILED) || (u->cqRing == MAP_FAILED) || (u->sqes == MAP_FAILED)) {
+        fprintf(stderr, "Couldn't map io_uring: %s\n", strerror(errno));
+        uringClose(u);
+        return -1;
+    }
+
+    unsigned char *sq = u->sqRing;
+    u->sqHead = (unsigned int *)(sq + p.sq_off.head);
+    u->sqTail = (unsigned int *)(sq + p.sq_off.tail);
+    u->sqMask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    u->sqArray = (unsigned int *)(sq + p.sq_off.array);
+    unsigned char *cq = u->cqRing;
+    u->cqHead = (unsigned int *)(cq + p.cq_off.head);
+    u->cqTail = (unsigned int *)(cq + p.cq_off.tail);
+    u->cqMask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // A registered buffer is pinned once, not for every read
+    struct iovec iov;
+    iov.iov_base = u->buffer;
+    iov.iov_len = sizeof(u->buffer);
+    if (uringRegister(u->ring, IORING_REGISTER_BUFFERS, &iov, 1) == -1) {
+        fprintf(stderr, "Couldn't register io_uring buffer: %s\n", strerror(errno));
+        uringClose(u);
+        return -1;
+    }
+
+    // In non-blocking mode the kernel completes reads with EAGAIN instead of waiting
+    int flags = fcntl(fd, F_GETFL);
+    if ((flags == -1) || (fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1)) {
+        fprintf(stderr, "Couldn't make port blocking: %s\n", strerror(errno));
+        uringClose(u);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Queue the next read, submitted by the next wait
+static void uringQueue(struct uring_t *u) {
+    unsigned int tail = *u->sqTail;
+    unsigned int index = tail & *u->sqMask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = u->fd;
+    sqe->addr = (uint64_t)(uintptr_t)u->buffer;
+    sqe->len = sizeof(u->buffer);
+    sqe->off = (uint64_t)-1; // current position, a serial port has none
+    sqe->buf_index = 0;
+    sqe->user_data = READTAG;
+    u->sqArray[index] = index;
+    __atomic_store_n(u->sqTail, tail + 1, __ATOMIC_RELEASE);
+    u->queued++;
+    u->reading = 1;
+}
+
+// Take a completion, if there is one. Returns 1 if data is available, -1 on error.
+static int uringReap(struct uring_t *u) {
+    unsigned int head = *u->cqHead;
+    if (head == __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    struct io_uring_cqe *cqe = &u->cqes[head & *u->cqMask];
+    int res = cqe->res;
+    __atomic_store_n(u->cqHead, head + 1, __ATOMIC_RELEASE);
+    u->reading = 0;
+
+    if (res > 0) {
+        u->available = res;
+        u->offset = 0;
+        return 1;
+    }
+
+    // Interrupted reads are simply tried again
+    if ((res == -EINTR) || (res == -EAGAIN)) {
+        uringQueue(u);
+        return 0;
+    }
+    fprintf(stderr, "Error while reading: %s\n", (res == 0) ? "end of file" : strerror(-res));
+    return -1;
+}
+
+int uringWait(struct uring_t *u, uint64_t deadline) {
+    if (u->available > 0) {
+        return 1;
+    }
+    if (!u->reading) {
+        uringQueue(u);
+    }
+
+    for (;;) {
+        int ret = uringReap(u);
+        if (ret != 0) {
+            return ret;
+        }
+
+        uint64_t now = serialTime();
+        uint64_t remaining = (deadline > now) ? (deadline - now) : 0;
+        struct __kernel_timespec ts;
+        ts.tv_sec = remaining / 1000000;
+        ts.tv_nsec = (remaining % 1000000) * 1000;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+        // Submit the queued read and wait for it in one call
+        int submitted = uringEnter(u, u->queued, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                &arg, sizeof(arg));
+        if (submitted >= 0) {
+            u->queued -= submitted;
+        } else if ((errno == ETIME) || (errno == EINTR)) {
+            return uringReap(u);
+        } else if (errno != EBUSY) {
+            fprintf(stderr, "Error while waiting for io_uring: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+}
+
+int uringRead(struct uring_t *u, unsigned char *data, int length, uint64_t deadline) {
+    int ret = uringWait(u, deadline);
+    if (ret != 1) {
+        return ret;
+    }
+
+    int count = (u->available < length) ? u->available : length;
+    memcpy(data, u->buffer + u->offset, count);
+    u->offset += count;
+    u->available -= count;
+    if (u->available == 0) {
+        uringQueue(u);
+    }
+    return count;
+}
+
+void uringClose(struct uring_t *u) {
+    if (u->ring == -1) {
+        return;
+    }
+
+    // Closing the ring cancels the read in flight
+    uringUnmap(u);
+    close(u->ring);
+    u->ring = -1;
+}
+
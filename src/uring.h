@@ -0,0 +1,102 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Linux io_uring reading of a serial port, using the system calls
+ * directly instead of liburing. Needs Linux 5.11 or newer.
+ */
+
+/*
+ * Configuration
+ */
+
+#define URING_ENTRIES 4 //!< Size of the submission queue
+#define URING_BUFFERSIZE 1024 //!< Size of the registered read buffer
+
+/*
+ * Types
+ */
+
+/*!
+ * \brief A ring with one read always queued or in flight.
+ *
+ * The next read is queued as soon as the data of the last one has
+ * been taken, and submitted together with waiting for its completion,
+ * so every read costs a single system call. A read that finds data
+ * already waiting completes right away, inside of the same call.
+ */
+struct uring_t {
+    int ring; //!< io_uring file descriptor, -1 if not open
+    int fd; //!< file that is read
+
+    unsigned int *sqHead, *sqTail, *sqMask, *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned int *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    void *sqRing, *cqRing; //!< mapped rings, the same if the kernel maps both at once
+    size_t sqSize, cqSize, sqesSize;
+
+    int reading; //!< a read is queued or in flight
+    int queued; //!< reads queued, but not submitted yet
+    int available; //!< bytes of a completed read not taken yet
+    int offset; //!< position of these bytes in buffer
+    unsigned long syscalls; //!< io_uring_enter() calls
+
+    _Alignas(64) unsigned char buffer[URING_BUFFERSIZE]; //!< registered with the kernel
+};
+
+/*
+ * Usage
+ */
+
+/*!
+ * \brief set up a ring reading from a file
+ *
+ * The file is switched to blocking mode, so the kernel waits for
+ * data instead of completing reads with EAGAIN.
+ *
+ * \param u ring to initialize
+ * \param fd file to read from, eg. a serial port
+ * \returns 0 on success, -1 if io_uring is not available
+ */
+int uringOpen(struct uring_t *u, int fd);
+
+/*!
+ * \brief wait until a read completed, like serialWait()
+ * \param u ring
+ * \param deadline when to give up, see serialTime()
+ * \returns 1 if data is available, 0 on timeout or signal, -1 on error
+ */
+int uringWait(struct uring_t *u, uint64_t deadline);
+
+/*!
+ * \brief take the data of a completed read, waiting for it, like serialRead()
+ * \param u ring
+ * \param data buffer receiving the data
+ * \param length size of data, anything not fitting is returned next time
+ * \param deadline when to give up, see serialTime()
+ * \returns number of bytes read, 0 on timeout or signal, -1 on error
+ */
+int uringRead(struct uring_t *u, unsigned char *data, int length, uint64_t deadline);
+
+/*!
+ * \brief cancel the read in flight and free the ring
+ * \param u ring, the file is not closed
+ */
+void uringClose(struct uring_t *u);
+
+#endif
+